@@ -83,7 +83,7 @@ popd
 
 pushd scripts
 %{__cxx} -std=c++17 -O2 blink-disk.cpp -o ugreen-blink-disk
-%{__cxx} -std=c++17 -O2 check-standby.cpp -o ugreen-check-standby
+%{__cxx} -std=c++17 -O2 -pthread check-standby.cpp -o ugreen-check-standby
 popd
 
 whitelist="/lib/modules/kabi-current/kabi_stablelist_%{_target_cpu}"
@@ -41,7 +41,7 @@ chmod +x $pkgname/DEBIAN/prerm
 # dkms files
 mkdir -p $pkgname/usr/src/$drivername-$pkgver
 
-kmod_files=(kmod/Makefile kmod/dkms.conf kmod/led-ugreen.c kmod/led-ugreen.h kmod/Makefile)
+kmod_files=(kmod/Makefile kmod/dkms.conf kmod/led-ugreen.c kmod/led-ugreen.h kmod/led-ugreen-trace.h kmod/Makefile)
 for f in ${kmod_files[@]}; do
     cp -rv $f $pkgname/usr/src/$drivername-$pkgver/
 done
@@ -44,7 +44,7 @@ g++ -std=c++17 -O2 scripts/blink-disk.cpp -o ugreen-blink-disk
 cp ugreen-blink-disk $pkgname/usr/bin
 
 # compile the disk standby monitor
-#g++ -std=c++17 -O2 scripts/check-standby.cpp -o ugreen-check-standby
+#g++ -std=c++17 -O2 -pthread scripts/check-standby.cpp -o ugreen-check-standby
 #cp ugreen-check-standby $pkgname/usr/bin
 
 # change to root 
@@ -0,0 +1,174 @@
+// Writes a sparse image file with the four ZFS vdev labels of a single disk
+// pool, laid out and XDR encoded like the labels written by `zpool create`:
+//
+//   mkzfslabel IMAGE
+//
+// The labels at the front have an older txg and pool name than the labels at
+// the end, as after a config change that was interrupted, so the reader has
+// to pick the newest pair. See zfs-label-test for the values.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t LABEL_SIZE = 256 * 1024;
+constexpr uint64_t PHYS_OFFSET = 16 * 1024;
+constexpr size_t PHYS_SIZE = 112 * 1024;
+constexpr size_t ECK_SIZE = 40;
+constexpr uint64_t ECK_MAGIC = 0x0210da7ab10c7a11ULL;
+
+// not a multiple of the label size, the labels at the end are placed from
+// the size rounded down
+constexpr uint64_t IMAGE_SIZE = 64 * 1024 * 1024 + 12345;
+
+constexpr uint32_t DATA_TYPE_UINT64 = 8;
+constexpr uint32_t DATA_TYPE_STRING = 9;
+constexpr uint32_t DATA_TYPE_NVLIST = 19;
+
+constexpr uint64_t POOL_GUID = 4285616421409316377ULL;
+constexpr uint64_t VDEV_GUID = 10981229484395478215ULL;
+
+using bytes_t = std::vector<uint8_t>;
+
+void put32(bytes_t &out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(uint8_t(value >> shift));
+    }
+}
+
+void put64(bytes_t &out, uint64_t value) {
+    put32(out, uint32_t(value >> 32));
+    put32(out, uint32_t(value));
+}
+
+void put_string(bytes_t &out, const std::string &value) {
+    put32(out, value.size());
+    out.insert(out.end(), value.begin(), value.end());
+    out.resize((out.size() + 3) & ~size_t(3), 0);
+}
+
+// an nvpair: encoded and decoded size, name, type, number of elements, value
+bytes_t pair(const std::string &name, uint32_t type, const bytes_t &value) {
+    bytes_t body;
+    put_string(body, name);
+    put32(body, type);
+    put32(body, 1);
+    body.insert(body.end(), value.begin(), value.end());
+
+    bytes_t out;
+    put32(out, 8 + body.size());
+    put32(out, 8 + body.size() + 8);
+    out.insert(out.end(), body.begin(), body.end());
+    return out;
+}
+
+bytes_t uint64_pair(const std::string &name, uint64_t value) {
+    bytes_t encoded;
+    put64(encoded, value);
+    return pair(name, DATA_TYPE_UINT64, encoded);
+}
+
+bytes_t string_pair(const std::string &name, const std::string &value) {
+    bytes_t encoded;
+    put_string(encoded, value);
+    return pair(name, DATA_TYPE_STRING, encoded);
+}
+
+// an nvlist: version, NV_UNIQUE_NAME, the pairs and two zero sizes
+bytes_t nvlist(const std::vector<bytes_t> &pairs) {
+    bytes_t out;
+    put32(out, 0);
+    put32(out, 1);
+    for (const auto &p : pairs) {
+        out.insert(out.end(), p.begin(), p.end());
+    }
+    put32(out, 0);
+    put32(out, 0);
+    return out;
+}
+
+// vdev_phys_t: the XDR nvlist of the config and the embedded checksum
+bytes_t vdev_phys(const std::string &pool_name, uint64_t txg) {
+    bytes_t vdev_tree = nvlist({
+        string_pair("type", "disk"),
+        uint64_pair("id", 0),
+        uint64_pair("guid", VDEV_GUID),
+        string_pair("path", "/dev/disk/by-id/ata-ST4000VN008-2DR166_ZDH1ABCD-part1"),
+        uint64_pair("whole_disk", 1),
+        uint64_pair("metaslab_array", 128),
+        uint64_pair("metaslab_shift", 34),
+        uint64_pair("ashift", 12),
+        uint64_pair("asize", 4000771997696ULL),
+        uint64_pair("is_log", 0),
+        uint64_pair("create_txg", 4),
+    });
+
+    bytes_t config = nvlist({
+        uint64_pair("version", 5000),
+        string_pair("name", pool_name),
+        uint64_pair("state", 0),
+        uint64_pair("txg", txg),
+        uint64_pair("pool_guid", POOL_GUID),
+        uint64_pair("errata", 0),
+        uint64_pair("hostid", 0x1b2c3d4e),
+        string_pair("hostname", "nas"),
+        uint64_pair("top_guid", VDEV_GUID),
+        uint64_pair("guid", VDEV_GUID),
+        uint64_pair("vdev_children", 1),
+        pair("vdev_tree", DATA_TYPE_NVLIST, vdev_tree),
+        pair("features_for_read", DATA_TYPE_NVLIST, nvlist({})),
+    });
+
+    // nvs_header_t: XDR encoding, big endian
+    bytes_t phys = { 1, 0, 0, 0 };
+    phys.insert(phys.end(), config.begin(), config.end());
+    phys.resize(PHYS_SIZE, 0);
+
+    // the magic of the checksum is written in the byte order of the host (x86)
+    for (int i = 0; i < 8; i++) {
+        phys[PHYS_SIZE - ECK_SIZE + i] = uint8_t(ECK_MAGIC >> (8 * i));
+    }
+    return phys;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " IMAGE" << std::endl;
+        return 1;
+    }
+
+    int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, IMAGE_SIZE) != 0) {
+        std::cerr << "Failed to create " << argv[1] << std::endl;
+        return 1;
+    }
+
+    uint64_t end = IMAGE_SIZE - IMAGE_SIZE % LABEL_SIZE;
+    struct { uint64_t offset; const char *pool_name; uint64_t txg; } labels[] = {
+        { 0, "oldtank", 10 },
+        { LABEL_SIZE, "oldtank", 10 },
+        { end - 2 * LABEL_SIZE, "tank", 12 },
+        { end - LABEL_SIZE, "tank", 12 },
+    };
+
+    for (const auto &label : labels) {
+        bytes_t phys = vdev_phys(label.pool_name, label.txg);
+        if (pwrite(fd, phys.data(), phys.size(), label.offset + PHYS_OFFSET) != ssize_t(phys.size())) {
+            std::cerr << "Failed to write " << argv[1] << std::endl;
+            close(fd);
+            return 1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,901 @@
+#include "ugreen_diskiomon.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using steady_clock = std::chrono::steady_clock;
+
+// a disk in standby only spins up on I/O, so it is asked again only this often
+static const auto STANDBY_RECHECK = std::chrono::seconds(60);
+// power mode probes run on a few workers, and a probe not answered in time is
+// given up with its disk; the first probe of a disk may try three commands
+static const int PROBE_WORKERS = 4;
+static const auto PROBE_DEADLINE = std::chrono::seconds(5);
+// how often a SMART check running in the background is looked at
+static const auto SMART_POLL_INTERVAL = std::chrono::seconds(1);
+// the sampling interval of disk activity starts to grow after this much idle time
+static const auto ACTIVITY_IDLE_GRACE = std::chrono::seconds(1);
+// the oneshot blink of the disk LEDs (delay_on + delay_off)
+static const auto BLINK_OFF_TIME = std::chrono::milliseconds(100);
+static const auto BLINK_TIME = std::chrono::milliseconds(200);
+
+static steady_clock::duration toDuration(double seconds) {
+    return std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+static std::string colorString(const LedColor& color) {
+    return std::to_string(color.r) + " " + std::to_string(color.g) + " " + std::to_string(color.b);
+}
+
+// Default Configuration Constructor
+DiskIoMonitorConfig::DiskIoMonitorConfig() :
+    mapping_method("ata"),
+    led_refresh_interval(0.1),
+    led_refresh_max_interval(1),
+    check_standby(true),
+    standby_check_interval(1),
+    standby_spindown_timeout(0),
+    check_smart(true),
+    check_smart_interval(360),
+    smartctl_path("/usr/sbin/smartctl"),
+    check_zpool(false),
+    check_zpool_interval(5),
+    check_disk_online_interval(5),
+    color_disk_health(255, 255, 255),   // White
+    color_disk_unavail(255, 0, 0),      // Red
+    color_disk_standby(0, 0, 255),      // Blue
+    color_zpool_fail(255, 0, 0),        // Red
+    color_smart_fail(255, 0, 0),        // Red
+    brightness_disk_leds(255),
+    tick_report_interval(0)
+{
+}
+
+DiskSlot::DiskSlot() :
+    index(0),
+    state(DiskSlotState::HEALTHY),
+    stats_present(false),
+    completed_ios(0),
+    in_flight(0),
+    probe_in_flight(false)
+{
+}
+
+// Disk LEDs Implementation
+DiskLeds::DiskLeds() : use_sysfs_(false) {}
+
+DiskLeds::~DiskLeds() {
+    for (auto& entry : files_) {
+        if (entry.second.shot_fd >= 0) close(entry.second.shot_fd);
+        if (entry.second.color_fd >= 0) close(entry.second.color_fd);
+    }
+}
+
+bool DiskLeds::sysfsAvailable() {
+    for (int i = 1; i <= 8; ++i) {
+        if (fileExists("/sys/class/leds/disk" + std::to_string(i))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DiskLeds::initialize() {
+    // the kernel module is preferred, the LEDs then keep blinking in hardware
+    use_sysfs_ = sysfsAvailable();
+
+    if (use_sysfs_) {
+        std::ifstream trigger("/sys/class/leds/disk1/trigger");
+        std::string triggers((std::istreambuf_iterator<char>(trigger)), std::istreambuf_iterator<char>());
+        if (triggers.find("oneshot") == std::string::npos) {
+            system("modprobe ledtrig_oneshot 2>/dev/null");
+        }
+        return true;
+    }
+
+    system("modprobe i2c-dev 2>/dev/null");
+
+    try {
+        led_controller_ = std::make_unique<ugreen_leds_t>();
+        return (led_controller_->start() == 0);
+    } catch (const std::exception& e) {
+        std::cerr << "Error initializing LED controller: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool DiskLeds::writeAttribute(const std::string& led_name, const std::string& attribute, const std::string& value) {
+    std::ofstream file("/sys/class/leds/" + led_name + "/" + attribute);
+    file << value;
+    file.close();
+    return !file.fail();
+}
+
+ugreen_leds_t::led_type_t DiskLeds::ledType(int slot_index) const {
+    return static_cast<ugreen_leds_t::led_type_t>(
+        static_cast<int>(ugreen_leds_t::led_type_t::disk1) + slot_index);
+}
+
+bool DiskLeds::setup(const DiskSlot& slot, const LedColor& color, uint8_t brightness) {
+    if (!use_sysfs_) {
+        auto id = ledType(slot.index);
+        return led_controller_->set_rgb(id, color.r, color.g, color.b) == 0
+            && led_controller_->set_brightness(id, brightness) == 0
+            && led_controller_->set_onoff(id, 1) == 0;
+    }
+
+    // same setup as ugreen-diskiomon: a short inverted blink on each shot
+    bool ok = writeAttribute(slot.led_name, "trigger", "oneshot")
+        && writeAttribute(slot.led_name, "invert", "1")
+        && writeAttribute(slot.led_name, "delay_on", "100")
+        && writeAttribute(slot.led_name, "delay_off", "100")
+        && writeAttribute(slot.led_name, "color", colorString(color))
+        && writeAttribute(slot.led_name, "brightness", std::to_string(brightness));
+
+    // the files written on each change are kept open
+    std::string led_path = "/sys/class/leds/" + slot.led_name;
+    LedFiles& files = files_[slot.index];
+    files.shot_fd = open((led_path + "/shot").c_str(), O_WRONLY | O_CLOEXEC);
+    files.color_fd = open((led_path + "/color").c_str(), O_WRONLY | O_CLOEXEC);
+
+    return ok && files.shot_fd >= 0 && files.color_fd >= 0;
+}
+
+void DiskLeds::turnOff(const DiskSlot& slot) {
+    if (!use_sysfs_) {
+        led_controller_->set_onoff(ledType(slot.index), 0);
+        return;
+    }
+
+    writeAttribute(slot.led_name, "brightness", "0");
+    writeAttribute(slot.led_name, "trigger", "none");
+}
+
+bool DiskLeds::setColor(const DiskSlot& slot, const LedColor& color) {
+    if (!use_sysfs_) {
+        return led_controller_->set_rgb(ledType(slot.index), color.r, color.g, color.b) == 0;
+    }
+
+    auto it = files_.find(slot.index);
+    if (it == files_.end() || it->second.color_fd < 0) {
+        return false;
+    }
+
+    std::string value = colorString(color);
+    return pwrite(it->second.color_fd, value.c_str(), value.size(), 0) >= 0;
+}
+
+void DiskLeds::shot(const DiskSlot& slot, steady_clock::time_point now) {
+    if (use_sysfs_) {
+        auto it = files_.find(slot.index);
+        if (it != files_.end() && it->second.shot_fd >= 0) {
+            pwrite(it->second.shot_fd, "1", 1, 0);
+        }
+        return;
+    }
+
+    // over I2C, the blink is emulated by turning the LED off for a moment
+    auto it = blinks_.find(slot.index);
+    if (it != blinks_.end() && now < it->second.until) {
+        return;
+    }
+
+    led_controller_->set_onoff(ledType(slot.index), 0);
+    blinks_[slot.index] = {now + BLINK_OFF_TIME, now + BLINK_TIME, true};
+}
+
+bool DiskLeds::update(steady_clock::time_point now) {
+    for (auto it = blinks_.begin(); it != blinks_.end(); ) {
+        EmulatedBlink& blink = it->second;
+
+        if (blink.off && now >= blink.on_at) {
+            led_controller_->set_onoff(ledType(it->first), 1);
+            blink.off = false;
+        }
+
+        if (!blink.off && now >= blink.until) {
+            it = blinks_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    return !blinks_.empty();
+}
+
+// Disk I/O Monitor Implementation
+DiskIoMonitor::DiskIoMonitor() :
+    disk_mapper_(std::make_unique<DiskMapper>()),
+    running_(false),
+    report_requested_(false),
+    diskstats_fd_(-1),
+    activity_interval_(0)
+{
+}
+
+DiskIoMonitor::~DiskIoMonitor() {
+    cleanup();
+}
+
+bool DiskIoMonitor::loadConfig(const std::string& config_file) {
+    std::vector<std::string> config_paths;
+    if (config_file.empty()) {
+        // unRAID settings first, overridden by the common config file
+        config_paths = {"/boot/config/plugins/ugreenleds-driver/settings.cfg", "/etc/ugreen-leds.conf"};
+    } else {
+        config_paths = {config_file};
+    }
+
+    bool loaded = false;
+    for (const auto& config_path : config_paths) {
+        std::ifstream file(config_path);
+        if (!file.is_open()) {
+            continue;
+        }
+
+        std::string line;
+        while (std::getline(file, line)) {
+            parseConfigLine(line);
+        }
+        loaded = true;
+    }
+
+    // unRAID checks the SMART status by itself
+    if (fileExists("/etc/unraid-version")) {
+        config_.check_smart = false;
+    }
+
+    if (!loaded) {
+        std::cout << "Config file not found, using defaults" << std::endl;
+    }
+    return loaded;
+}
+
+void DiskIoMonitor::parseConfigLine(const std::string& line) {
+    std::string trimmed = trimString(line);
+    if (trimmed.empty() || trimmed[0] == '#') {
+        return;
+    }
+
+    size_t equals_pos = trimmed.find('=');
+    if (equals_pos == std::string::npos) {
+        return;
+    }
+
+    std::string key = trimString(trimmed.substr(0, equals_pos));
+    std::string value = trimString(trimmed.substr(equals_pos + 1));
+
+    // Remove inline comments
+    size_t comment_pos = value.find('#');
+    if (comment_pos != std::string::npos) {
+        value = trimString(value.substr(0, comment_pos));
+    }
+
+    // Remove quotes if present
+    if (value.length() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front()) {
+        value = value.substr(1, value.length() - 2);
+    }
+
+    // Bash arrays (e.g., BLINK_MON_OPTIONS) are options of the helper tools
+    if (!value.empty() && value.front() == '(') {
+        return;
+    }
+
+    try {
+        if (key == "MAPPING_METHOD") {
+            config_.mapping_method = value;
+        } else if (key == "DISK_SERIAL") {
+            config_.serial_map = splitString(value, ' ');
+        } else if (key == "LED_REFRESH_INTERVAL") {
+            config_.led_refresh_interval = std::stod(value);
+        } else if (key == "LED_REFRESH_MAX_INTERVAL") {
+            config_.led_refresh_max_interval = std::stod(value);
+        } else if (key == "STANDBY_CHECK_INTERVAL") {
+            config_.standby_check_interval = std::stod(value);
+        } else if (key == "STANDBY_SPINDOWN_TIMEOUT") {
+            config_.standby_spindown_timeout = std::stod(value);
+        } else if (key == "CHECK_STANDBY") {
+            config_.check_standby = (value == "true");
+        } else if (key == "CHECK_SMART") {
+            config_.check_smart = (value == "true");
+        } else if (key == "CHECK_SMART_INTERVAL") {
+            config_.check_smart_interval = std::stoi(value);
+        } else if (key == "SMARTCTL_PATH") {
+            config_.smartctl_path = value;
+        } else if (key == "CHECK_ZPOOL") {
+            config_.check_zpool = (value == "true");
+        } else if (key == "CHECK_ZPOOL_INTERVAL") {
+            config_.check_zpool_interval = std::stoi(value);
+        } else if (key == "CHECK_DISK_ONLINE_INTERVAL") {
+            config_.check_disk_online_interval = std::stoi(value);
+        } else if (key == "COLOR_DISK_HEALTH") {
+            config_.color_disk_health = stringToColor(value);
+        } else if (key == "COLOR_DISK_UNAVAIL") {
+            config_.color_disk_unavail = stringToColor(value);
+        } else if (key == "COLOR_DISK_STANDBY") {
+            config_.color_disk_standby = stringToColor(value);
+        } else if (key == "COLOR_ZPOOL_FAIL") {
+            config_.color_zpool_fail = stringToColor(value);
+        } else if (key == "COLOR_SMART_FAIL") {
+            config_.color_smart_fail = stringToColor(value);
+        } else if (key == "TICK_REPORT_INTERVAL") {
+            config_.tick_report_interval = std::stoi(value);
+        } else if (key == "BRIGHTNESS_DISK_LEDS") {
+            config_.brightness_disk_leds = static_cast<uint8_t>(std::clamp(std::stoi(value), 0, 255));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: Invalid " << key << " value '" << value << "', using default" << std::endl;
+    }
+}
+
+void DiskIoMonitor::setConfig(const DiskIoMonitorConfig& config) {
+    config_ = config;
+}
+
+DiskIoMonitorConfig DiskIoMonitor::getConfig() const {
+    return config_;
+}
+
+bool DiskIoMonitor::configureMapping() {
+    if (config_.mapping_method == "ata") {
+        disk_mapper_->setMappingMethod(DiskMapper::MappingMethod::ATA);
+    } else if (config_.mapping_method == "hctl") {
+        disk_mapper_->setMappingMethod(DiskMapper::MappingMethod::HCTL);
+    } else if (config_.mapping_method == "serial") {
+        disk_mapper_->setMappingMethod(DiskMapper::MappingMethod::SERIAL);
+        disk_mapper_->setSerialMap(config_.serial_map);
+    } else {
+        logError("Unsupported mapping method: " + config_.mapping_method);
+        return false;
+    }
+    return true;
+}
+
+bool DiskIoMonitor::initialize() {
+    if (!configureMapping()) {
+        return false;
+    }
+
+    if (!leds_.initialize()) {
+        logError("Neither the led-ugreen module nor the I2C LED controller is available");
+        return false;
+    }
+    logMessage(std::string("Using the disk LEDs through ") + (leds_.usesSysfs() ? "sysfs" : "I2C"));
+
+    if (config_.check_smart && access(config_.smartctl_path.c_str(), X_OK) != 0) {
+        logError(config_.smartctl_path + " is not found, SMART checks are disabled");
+        config_.check_smart = false;
+    }
+
+    diskstats_fd_ = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    if (diskstats_fd_ < 0) {
+        logError("Failed to open /proc/diskstats, disk activity is not shown");
+    }
+
+    buildInventory();
+    scheduleTasks();
+    return true;
+}
+
+// find the disk of each slot, without touching the LEDs
+void DiskIoMonitor::mapSlots(bool sysfs_leds) {
+    slots_.clear();
+    for (int i = 0; i < 8; ++i) {
+        DiskSlot slot;
+        slot.index = i;
+        slot.led_name = "disk" + std::to_string(i + 1);
+
+        if (sysfs_leds && !fileExists("/sys/class/leds/" + slot.led_name)) {
+            continue;
+        }
+
+        // the mapping forks lsblk / readlink, but only once at startup
+        std::string device = disk_mapper_->getDiskDevice(i);
+        if (!device.empty()) {
+            device = device.substr(device.find_last_of('/') + 1);
+        }
+
+        if (!device.empty() && fileExists("/sys/class/block/" + device + "/stat")) {
+            slot.device_name = device;
+        }
+        slots_.push_back(slot);
+    }
+}
+
+void DiskIoMonitor::buildInventory() {
+    logMessage("Enumerating disks based on " + config_.mapping_method + "...");
+
+    mapSlots(leds_.usesSysfs());
+    for (auto& slot : slots_) {
+        if (slot.device_name.empty()) {
+            // turn off the led if no disk installed on this slot
+            leds_.turnOff(slot);
+            continue;
+        }
+
+        if (!leds_.setup(slot, config_.color_disk_health, config_.brightness_disk_leds)) {
+            logError("Failed to set up " + slot.led_name);
+        }
+
+        if (config_.check_standby) {
+            slot.disk.fd = open(("/dev/" + slot.device_name).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (slot.disk.fd < 0) {
+                logError("Failed to open /dev/" + slot.device_name + ", its standby is not shown");
+            }
+        }
+
+        logMessage(slot.led_name + " >> /dev/" + slot.device_name);
+    }
+}
+
+void DiskIoMonitor::scheduleTasks() {
+    auto now = steady_clock::now();
+
+    activity_interval_ = toDuration(config_.led_refresh_interval);
+    last_activity_at_ = now;
+
+    tasks_.clear();
+    tasks_.push_back({"activity", now, [this](steady_clock::time_point t) { return checkActivity(t); }});
+    tasks_.push_back({"online", now, [this](steady_clock::time_point t) { return checkDiskOnline(t); }});
+
+    if (config_.check_standby) {
+        standby_policy_.check_interval = toDuration(config_.standby_check_interval);
+        standby_policy_.spindown_timeout = toDuration(config_.standby_spindown_timeout);
+        standby_policy_.standby_recheck = STANDBY_RECHECK;
+        probe_pool_ = std::make_unique<disk_power::probe_pool_t>(PROBE_WORKERS);
+        tasks_.push_back({"standby", now, [this](steady_clock::time_point t) { return checkStandby(t); }});
+    }
+    if (config_.check_smart) {
+        tasks_.push_back({"smart", now, [this](steady_clock::time_point t) { return checkSmart(t); }});
+    }
+    if (config_.check_zpool) {
+        tasks_.push_back({"zpool", now, [this](steady_clock::time_point t) { return checkZpool(t); }});
+    }
+    if (config_.tick_report_interval > 0) {
+        tasks_.push_back({"report", now + std::chrono::seconds(config_.tick_report_interval),
+            [this](steady_clock::time_point t) {
+                reportTaskTimes();
+                return std::chrono::seconds(config_.tick_report_interval);
+            }});
+    }
+}
+
+void DiskIoMonitor::requestTaskReport() {
+    report_requested_ = true;
+}
+
+// print how long each task took since the last report, and reset the counters
+void DiskIoMonitor::reportTaskTimes() {
+    auto us = [](steady_clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    };
+
+    std::cout << "Task run times:" << std::endl;
+    for (auto& task : tasks_) {
+        if (task.runs == 0 || task.name == "report") {
+            continue;
+        }
+
+        char line[160];
+        snprintf(line, sizeof(line), "  %-8s %8llu runs, avg %9.1f us, max %9.1f us, max late %9.1f us",
+                 task.name.c_str(), static_cast<unsigned long long>(task.runs),
+                 us(task.total_time) / task.runs, us(task.max_time), us(task.max_lateness));
+        std::cout << line << std::endl;
+
+        task.runs = 0;
+        task.total_time = task.max_time = task.max_lateness = steady_clock::duration::zero();
+    }
+}
+
+void DiskIoMonitor::cleanup() {
+    running_ = false;
+
+    // the fd of a probe still in flight was given up with its worker
+    for (auto& slot : slots_) {
+        if (slot.disk.fd >= 0 && !slot.probe_in_flight) {
+            close(slot.disk.fd);
+        }
+        slot.disk.fd = -1;
+    }
+
+    if (diskstats_fd_ >= 0) {
+        close(diskstats_fd_);
+        diskstats_fd_ = -1;
+    }
+}
+
+void DiskIoMonitor::startMonitoring() {
+    running_ = true;
+
+    logMessage("Starting UGREEN disk I/O monitoring...");
+
+    // all checks run in this thread, each one when it is due, so the LED
+    // of a slot is only changed from here and never needs to be read back
+    while (running_) {
+        if (report_requested_) {
+            report_requested_ = false;
+            reportTaskTimes();
+        }
+
+        auto task = std::min_element(tasks_.begin(), tasks_.end(),
+            [](const ScheduledTask& a, const ScheduledTask& b) { return a.next_run < b.next_run; });
+
+        auto now = steady_clock::now();
+        if (task->next_run > now) {
+            std::this_thread::sleep_until(task->next_run);
+            continue;
+        }
+
+        auto delay = task->run(now);
+
+        auto finished = steady_clock::now();
+        task->runs++;
+        task->total_time += finished - now;
+        task->max_time = std::max(task->max_time, finished - now);
+        task->max_lateness = std::max(task->max_lateness, now - task->next_run);
+
+        task->next_run = std::max(task->next_run + delay, finished);
+    }
+
+    reportTaskTimes();
+}
+
+void DiskIoMonitor::stopMonitoring() {
+    running_ = false;
+}
+
+bool DiskIoMonitor::readDiskStats(steady_clock::time_point now) {
+    static char buf[64 * 1024];
+
+    ssize_t len = diskstats_fd_ >= 0 ? pread(diskstats_fd_, buf, sizeof(buf) - 1, 0) : -1;
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+
+    for (char* line = buf; line && *line; ) {
+        char* eol = strchr(line, '\n');
+        if (eol) *eol = '\0';
+
+        char name[64];
+        unsigned long long v[17] = { 0 };
+        int fields = sscanf(line, " %*u %*u %63s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+            name, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8],
+            &v[9], &v[10], &v[11], &v[12], &v[13], &v[14], &v[15], &v[16]);
+
+        if (fields >= 12) {
+            for (auto& slot : slots_) {
+                if (slot.device_name == name) {
+                    // fields: 0 reads, 4 writes, 8 in flight, 11 discards, 15 flushes
+                    // the first sample only sets the baseline
+                    uint64_t completed_ios = v[0] + v[4] + v[11] + v[15];
+                    if (slot.stats_present && (completed_ios != slot.completed_ios || v[8] > 0)) {
+                        slot.last_io_at = now;
+                    }
+
+                    slot.stats_present = true;
+                    slot.completed_ios = completed_ios;
+                    slot.in_flight = v[8];
+                }
+            }
+        }
+
+        line = eol ? eol + 1 : nullptr;
+    }
+
+    return true;
+}
+
+steady_clock::duration DiskIoMonitor::checkActivity(steady_clock::time_point now) {
+    auto min_interval = toDuration(config_.led_refresh_interval);
+    auto max_interval = std::max(min_interval, toDuration(config_.led_refresh_max_interval));
+
+    if (!readDiskStats(now)) {
+        return max_interval;
+    }
+
+    bool active = false;
+    for (auto& slot : slots_) {
+        if (slot.stats_present && slot.last_io_at == now) {
+            leds_.shot(slot, now);
+            active = true;
+        }
+    }
+
+    if (!leds_.usesSysfs() && leds_.update(now)) {
+        active = true;
+    }
+
+    // sample less and less often while all disks stay idle
+    if (active) {
+        last_activity_at_ = now;
+        activity_interval_ = min_interval;
+    } else if (now - last_activity_at_ >= ACTIVITY_IDLE_GRACE) {
+        activity_interval_ = std::min(activity_interval_ * 2, max_interval);
+    }
+
+    return activity_interval_;
+}
+
+// take the answers of the power mode probes that finished since the last check
+void DiskIoMonitor::applyStandbyProbes(steady_clock::time_point now) {
+    for (auto& result : probe_pool_->wait_results(now)) {
+        DiskSlot& slot = slots_[result.index];
+        slot.probe_in_flight = false;
+
+        // the probe was given up
+        if (slot.disk.fd < 0) {
+            continue;
+        }
+
+        if (result.disk.backend == disk_power::probe_backend_t::none || !result.standby.has_value()) {
+            logError("Failed to check power mode of /dev/" + slot.device_name + " ("
+                     + disk_power::backend_name(result.disk.backend) + "), its standby is not shown");
+            close(slot.disk.fd);
+            slot.disk.fd = -1;
+            continue;
+        }
+        slot.disk = result.disk;
+
+        // I/O seen while the probe was running wins over its answer
+        if (slot.state == DiskSlotState::FAILED || slot.last_io_at > slot.probe_queued_at) {
+            continue;
+        }
+
+        slot.standby.probed(result.standby.value(), standby_policy_);
+        if (result.standby.value()) {
+            setSlotState(slot, DiskSlotState::STANDBY, config_.color_disk_standby);
+        } else {
+            setSlotState(slot, DiskSlotState::HEALTHY, config_.color_disk_health);
+        }
+    }
+}
+
+steady_clock::duration DiskIoMonitor::checkStandby(steady_clock::time_point now) {
+    auto interval = standby_policy_.check_interval;
+    // I/O within one sampling period of the activity task is recent
+    auto recent = std::max(interval, toDuration(config_.led_refresh_max_interval));
+
+    applyStandbyProbes(now);
+
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        DiskSlot& slot = slots_[i];
+        if (slot.disk.fd < 0 || slot.state == DiskSlotState::FAILED) {
+            continue;
+        }
+
+        // an ioctl without a timeout (HDIO_DRIVE_CMD) may never return, so its
+        // worker is replaced and the fd is left to it
+        auto deadline = slot.disk.backend == disk_power::probe_backend_t::none ? PROBE_DEADLINE * 3 : PROBE_DEADLINE;
+        if (slot.probe_in_flight && now - slot.probe_queued_at > deadline) {
+            logError("Power mode probe of /dev/" + slot.device_name + " did not return, its standby is not shown");
+            slot.disk.fd = -1;
+            probe_pool_->add_worker();
+            continue;
+        }
+
+        // the power mode is inferred from the I/O of the disk when possible
+        if (slot.stats_present && now - slot.last_io_at <= recent) {
+            slot.standby.saw_io(slot.last_io_at, standby_policy_);
+            setSlotState(slot, DiskSlotState::HEALTHY, config_.color_disk_health);
+            continue;
+        }
+
+        if (slot.probe_in_flight || !slot.standby.needs_probe(slot.state == DiskSlotState::STANDBY, now, standby_policy_)) {
+            continue;
+        }
+
+        slot.standby.last_probe_at = now;
+        slot.probe_in_flight = true;
+        slot.probe_queued_at = now;
+        probe_pool_->submit(static_cast<int>(i), slot.disk);
+    }
+
+    return interval;
+}
+
+steady_clock::duration DiskIoMonitor::checkSmart(steady_clock::time_point now) {
+    // smartctl may take seconds per disk, so it runs in the background and
+    // its exit statuses are applied once all disks have been checked
+    if (smart_run_.valid()) {
+        if (smart_run_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return SMART_POLL_INTERVAL;
+        }
+
+        for (const auto& [i, status] : smart_run_.get()) {
+            // critical errors are any bit set except bit 5 (see smartctl(8), EXIT STATUS)
+            if (WEXITSTATUS(status) & ~32) {
+                failSlot(slots_[i], config_.color_smart_fail, "SMART status");
+            }
+        }
+        return std::chrono::seconds(config_.check_smart_interval);
+    }
+
+    std::vector<std::pair<size_t, std::string>> devices;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        // a disk in standby is not woken up for its SMART status
+        if (!slots_[i].device_name.empty() && slots_[i].state == DiskSlotState::HEALTHY) {
+            devices.emplace_back(i, slots_[i].device_name);
+        }
+    }
+
+    smart_run_ = std::async(std::launch::async, [devices, smartctl_path = config_.smartctl_path] {
+        std::vector<std::pair<size_t, int>> statuses;
+        for (const auto& [i, device] : devices) {
+            std::string cmd = smartctl_path + " -H /dev/" + device + " -n standby,0 > /dev/null 2>&1";
+            int status = system(cmd.c_str());
+            if (status != -1 && WIFEXITED(status)) {
+                statuses.emplace_back(i, status);
+            }
+        }
+        return statuses;
+    });
+
+    return SMART_POLL_INTERVAL;
+}
+
+int DiskIoMonitor::zpoolDeviceSlot(const std::string& zpool_device) {
+    auto cached = zpool_device_slots_.find(zpool_device);
+    if (cached != zpool_device_slots_.end()) {
+        return cached->second;
+    }
+
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::string disk;
+
+    if (zpool_device.rfind("sd", 0) == 0) {
+        // remove the trailing partition number
+        disk = zpool_device.substr(0, zpool_device.find_last_not_of("0123456789") + 1);
+    } else if (zpool_device.rfind("dm", 0) == 0) {
+        // find the underlying block device of the encrypted device
+        for (const auto& entry : fs::directory_iterator("/sys/block/" + zpool_device + "/slaves", ec)) {
+            disk = entry.path().filename().string();
+            break;
+        }
+
+        // a partition is resolved to its disk
+        if (!disk.empty() && fileExists("/sys/class/block/" + disk + "/partition")) {
+            disk = fs::canonical("/sys/class/block/" + disk, ec).parent_path().filename().string();
+        }
+    } else {
+        logError("Unsupported zpool device type " + zpool_device);
+    }
+
+    int index = -1;
+    for (const auto& slot : slots_) {
+        if (!disk.empty() && slot.device_name == disk) {
+            index = slot.index;
+            logMessage("zpool device " + zpool_device + " >> " + disk + " >> LED:" + slot.led_name);
+        }
+    }
+
+    zpool_device_slots_[zpool_device] = index;
+    return index;
+}
+
+steady_clock::duration DiskIoMonitor::checkZpool(steady_clock::time_point now) {
+    FILE* pipe = popen("zpool status -L 2>/dev/null", "r");
+    if (pipe) {
+        char buffer[512];
+        while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+            std::istringstream iss(buffer);
+            std::string name, state;
+            if (!(iss >> name >> state) || (name.rfind("sd", 0) != 0 && name.rfind("dm", 0) != 0)) {
+                continue;
+            }
+
+            int index = zpoolDeviceSlot(name);
+            if (index < 0 || state == "ONLINE") {
+                continue;
+            }
+
+            for (auto& slot : slots_) {
+                if (slot.index == index && slot.state != DiskSlotState::FAILED) {
+                    failSlot(slot, config_.color_zpool_fail, "zpool device " + name + " is " + state);
+                }
+            }
+        }
+        pclose(pipe);
+    }
+
+    return std::chrono::seconds(config_.check_zpool_interval);
+}
+
+steady_clock::duration DiskIoMonitor::checkDiskOnline(steady_clock::time_point now) {
+    for (auto& slot : slots_) {
+        if (slot.device_name.empty() || slot.state == DiskSlotState::FAILED) {
+            continue;
+        }
+
+        if (!fileExists("/sys/class/block/" + slot.device_name + "/stat")) {
+            failSlot(slot, config_.color_disk_unavail, "went offline");
+        }
+    }
+
+    return std::chrono::seconds(config_.check_disk_online_interval);
+}
+
+void DiskIoMonitor::setSlotState(DiskSlot& slot, DiskSlotState state, const LedColor& color) {
+    // a failure is shown until the daemon is restarted
+    if (slot.state == state || slot.state == DiskSlotState::FAILED) {
+        return;
+    }
+
+    slot.state = state;
+    if (!leds_.setColor(slot, color)) {
+        logError("Failed to update the color of " + slot.led_name);
+    }
+}
+
+void DiskIoMonitor::failSlot(DiskSlot& slot, const LedColor& color, const std::string& reason) {
+    if (slot.state == DiskSlotState::FAILED) {
+        return;
+    }
+
+    slot.state = DiskSlotState::FAILED;
+    if (!leds_.setColor(slot, color)) {
+        logError("Failed to update the color of " + slot.led_name);
+    }
+
+    std::cout << "Disk failure detected on /dev/" << slot.device_name << " at "
+              << getCurrentTimestamp() << " (" << reason << ")" << std::endl;
+}
+
+// only reads the mapping, so it may run next to the daemon without touching its LEDs
+bool DiskIoMonitor::showStatus() {
+    if (!configureMapping()) {
+        return false;
+    }
+
+    bool sysfs_leds = DiskLeds::sysfsAvailable();
+    mapSlots(sysfs_leds);
+
+    std::cout << "UGREEN Disk I/O Monitor Status:" << std::endl;
+    std::cout << "  LED interface: " << (sysfs_leds ? "sysfs (led-ugreen)" : "I2C") << std::endl;
+    std::cout << "  Mapping method: " << config_.mapping_method << std::endl;
+
+    for (const auto& slot : slots_) {
+        std::cout << "  " << slot.led_name << ": "
+                  << (slot.device_name.empty() ? "no disk" : "/dev/" + slot.device_name) << std::endl;
+    }
+
+    std::cout << "  Tasks: activity online";
+    if (config_.check_standby) {
+        std::cout << " standby";
+    }
+    if (config_.check_smart && access(config_.smartctl_path.c_str(), X_OK) == 0) {
+        std::cout << " smart";
+    }
+    if (config_.check_zpool) {
+        std::cout << " zpool";
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+LedColor DiskIoMonitor::stringToColor(const std::string& color_str) const {
+    std::istringstream iss(color_str);
+    int r = 0, g = 0, b = 0;
+    iss >> r >> g >> b;
+    return LedColor(static_cast<uint8_t>(std::clamp(r, 0, 255)),
+                    static_cast<uint8_t>(std::clamp(g, 0, 255)),
+                    static_cast<uint8_t>(std::clamp(b, 0, 255)));
+}
+
+void DiskIoMonitor::logMessage(const std::string& message) const {
+    std::cout << "[INFO] " << message << std::endl;
+}
+
+void DiskIoMonitor::logError(const std::string& error) const {
+    std::cerr << "[ERROR] " << error << std::endl;
+}
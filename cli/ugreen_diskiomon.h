@@ -0,0 +1,207 @@
+#ifndef UGREEN_DISKIOMON_H
+#define UGREEN_DISKIOMON_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <future>
+
+#include "zfs_monitor.h"  // For LedColor and DiskMapper
+#include "ugreen_leds.h"  // For LED control without the kernel module
+#include "../scripts/disk-power.h"  // Power mode probes shared with check-standby
+
+// Disk I/O Monitor Configuration (same keys as /etc/ugreen-leds.conf)
+struct DiskIoMonitorConfig {
+    std::string mapping_method;
+    std::vector<std::string> serial_map;
+
+    // Disk activity
+    double led_refresh_interval;        // seconds between diskstats samples while disks are busy
+    double led_refresh_max_interval;    // longest sampling interval while all disks are idle
+
+    // Disk standby
+    bool check_standby;
+    double standby_check_interval;
+    double standby_spindown_timeout;    // 0 if unknown
+
+    // Disk health
+    bool check_smart;
+    int check_smart_interval;
+    std::string smartctl_path;
+    bool check_zpool;
+    int check_zpool_interval;
+    int check_disk_online_interval;
+
+    // LED Colors
+    LedColor color_disk_health;
+    LedColor color_disk_unavail;
+    LedColor color_disk_standby;
+    LedColor color_zpool_fail;
+    LedColor color_smart_fail;
+    uint8_t brightness_disk_leds;
+
+    // Seconds between reports of the task run times (0 to disable)
+    int tick_report_interval;
+
+    // Default constructor with the defaults of ugreen-diskiomon
+    DiskIoMonitorConfig();
+};
+
+// State of a disk slot, a failure stays until the daemon is restarted
+enum class DiskSlotState {
+    HEALTHY = 0,
+    STANDBY = 1,
+    FAILED = 2
+};
+
+// One disk slot of the shared disk inventory
+struct DiskSlot {
+    int index;
+    std::string led_name;
+    std::string device_name;            // e.g. sda, empty if the slot has no disk
+    DiskSlotState state;
+
+    // Activity, updated by the diskstats sampler
+    bool stats_present;
+    uint64_t completed_ios;
+    uint64_t in_flight;
+    std::chrono::steady_clock::time_point last_io_at;
+
+    // Standby, only asked from the disk when it cannot be inferred from its I/O,
+    // by a probe running off the scheduler thread
+    disk_power::disk_t disk;
+    disk_power::standby_tracker_t standby;
+    bool probe_in_flight;
+    std::chrono::steady_clock::time_point probe_queued_at;
+
+    DiskSlot();
+};
+
+// Disk LEDs, through the led-ugreen sysfs interface or directly over I2C
+class DiskLeds {
+public:
+    DiskLeds();
+    ~DiskLeds();
+
+    bool initialize();
+    bool usesSysfs() const { return use_sysfs_; }
+    // whether the led-ugreen module is loaded, without initializing anything
+    static bool sysfsAvailable();
+
+    bool setup(const DiskSlot& slot, const LedColor& color, uint8_t brightness);
+    void turnOff(const DiskSlot& slot);
+    bool setColor(const DiskSlot& slot, const LedColor& color);
+
+    // blink once to show disk activity
+    void shot(const DiskSlot& slot, std::chrono::steady_clock::time_point now);
+    // finish the blinks emulated over I2C, and return whether one is still running
+    bool update(std::chrono::steady_clock::time_point now);
+
+private:
+    struct LedFiles {
+        int shot_fd = -1;
+        int color_fd = -1;
+    };
+
+    struct EmulatedBlink {
+        std::chrono::steady_clock::time_point on_at;
+        std::chrono::steady_clock::time_point until;
+        bool off;
+    };
+
+    bool use_sysfs_;
+    std::unique_ptr<ugreen_leds_t> led_controller_;
+    std::map<int, LedFiles> files_;
+    std::map<int, EmulatedBlink> blinks_;
+
+    bool writeAttribute(const std::string& led_name, const std::string& attribute, const std::string& value);
+    ugreen_leds_t::led_type_t ledType(int slot_index) const;
+};
+
+// A task run periodically by the scheduler, returning the delay to its next run
+struct ScheduledTask {
+    std::string name;
+    std::chrono::steady_clock::time_point next_run;
+    std::function<std::chrono::steady_clock::duration(std::chrono::steady_clock::time_point)> run;
+
+    // Run times since the last report, and how late the runs started
+    uint64_t runs = 0;
+    std::chrono::steady_clock::duration total_time{};
+    std::chrono::steady_clock::duration max_time{};
+    std::chrono::steady_clock::duration max_lateness{};
+};
+
+// Main Disk I/O Monitor Class
+class DiskIoMonitor {
+public:
+    DiskIoMonitor();
+    ~DiskIoMonitor();
+
+    // Configuration
+    bool loadConfig(const std::string& config_file = "");
+    void setConfig(const DiskIoMonitorConfig& config);
+    DiskIoMonitorConfig getConfig() const;
+
+    // Initialization
+    bool initialize();
+    void cleanup();
+
+    // Monitoring
+    void startMonitoring();
+    void stopMonitoring();
+
+    // Status and utilities, showStatus needs no initialize() and leaves the LEDs alone
+    bool showStatus();
+    void requestTaskReport();
+
+private:
+    DiskIoMonitorConfig config_;
+    std::unique_ptr<DiskMapper> disk_mapper_;
+    DiskLeds leds_;
+    std::vector<DiskSlot> slots_;
+    std::vector<ScheduledTask> tasks_;
+
+    volatile bool running_;
+    volatile bool report_requested_;
+    int diskstats_fd_;
+    std::chrono::steady_clock::duration activity_interval_;
+    std::chrono::steady_clock::time_point last_activity_at_;
+    std::map<std::string, int> zpool_device_slots_;
+
+    // Standby probes and SMART checks may block on a disk, so they run off the scheduler thread
+    std::unique_ptr<disk_power::probe_pool_t> probe_pool_;
+    disk_power::standby_policy_t standby_policy_;
+    std::future<std::vector<std::pair<size_t, int>>> smart_run_;
+
+    // Inventory
+    bool configureMapping();
+    void mapSlots(bool sysfs_leds);
+    void buildInventory();
+    void scheduleTasks();
+    void reportTaskTimes();
+
+    // Tasks
+    std::chrono::steady_clock::duration checkActivity(std::chrono::steady_clock::time_point now);
+    std::chrono::steady_clock::duration checkStandby(std::chrono::steady_clock::time_point now);
+    std::chrono::steady_clock::duration checkSmart(std::chrono::steady_clock::time_point now);
+    std::chrono::steady_clock::duration checkZpool(std::chrono::steady_clock::time_point now);
+    std::chrono::steady_clock::duration checkDiskOnline(std::chrono::steady_clock::time_point now);
+
+    // Utility functions
+    bool readDiskStats(std::chrono::steady_clock::time_point now);
+    void applyStandbyProbes(std::chrono::steady_clock::time_point now);
+    void setSlotState(DiskSlot& slot, DiskSlotState state, const LedColor& color);
+    void failSlot(DiskSlot& slot, const LedColor& color, const std::string& reason);
+    int zpoolDeviceSlot(const std::string& zpool_device);
+    LedColor stringToColor(const std::string& color_str) const;
+    void logMessage(const std::string& message) const;
+    void logError(const std::string& error) const;
+
+    // Configuration parsing
+    void parseConfigLine(const std::string& line);
+};
+
+#endif // UGREEN_DISKIOMON_H
@@ -0,0 +1,165 @@
+#include "ugreen_diskiomon.h"
+#include <iostream>
+#include <fstream>
+#include <signal.h>
+#include <getopt.h>
+#include <memory>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define DISKIOMON_LOCK_FILE "/var/run/ugreen-diskiomon.lock"
+
+std::unique_ptr<DiskIoMonitor> monitor_instance;
+
+void signal_handler(int signum) {
+    if (monitor_instance) {
+        if (signum == SIGUSR1) {
+            monitor_instance->requestTaskReport();
+        } else {
+            monitor_instance->stopMonitoring();
+        }
+    }
+}
+
+void print_usage() {
+    std::cout << "UGREEN NAS Disk Activity and Health Monitor (C++)\n\n";
+    std::cout << "USAGE:\n";
+    std::cout << "    ugreen_diskiomon [OPTIONS]\n\n";
+    std::cout << "OPTIONS:\n";
+    std::cout << "    -h, --help              Show this help message\n";
+    std::cout << "    -c, --config FILE       Use specific config file\n";
+    std::cout << "    -s, --status            Show the disk mapping and exit\n";
+    std::cout << "    -T, --tick-report SECONDS\n";
+    std::cout << "                            Report the run time of each task every SECONDS\n";
+    std::cout << "                            (also on SIGUSR1 and on exit)\n\n";
+    std::cout << "MONITORING FEATURES:\n";
+    std::cout << "    - Disk activity blinking, from /proc/diskstats\n";
+    std::cout << "    - Disk standby, inferred from the disk I/O\n";
+    std::cout << "    - S.M.A.R.T. health, zpool device state and disk presence\n\n";
+    std::cout << "    All checks run as scheduled tasks in one process and share one disk\n";
+    std::cout << "    inventory, replacing ugreen-diskiomon, ugreen-blink-disk and\n";
+    std::cout << "    ugreen-check-standby.\n\n";
+    std::cout << "CONFIG FILE:\n";
+    std::cout << "    Default location: /etc/ugreen-leds.conf (same keys as ugreen-diskiomon)\n";
+}
+
+// the lock file is shared with the bash ugreen-diskiomon, so only one of them runs
+static bool acquire_lock() {
+    int fd = open(DISKIOMON_LOCK_FILE, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (fd < 0 && errno == EEXIST) {
+        // a lock left by a crashed instance of this daemon is taken over
+        std::ifstream lock(DISKIOMON_LOCK_FILE);
+        pid_t pid = 0;
+        if (!(lock >> pid) || pid <= 0 || (kill(pid, 0) == 0 || errno != ESRCH)) {
+            return false;
+        }
+
+        unlink(DISKIOMON_LOCK_FILE);
+        fd = open(DISKIOMON_LOCK_FILE, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string pid = std::to_string(getpid()) + "\n";
+    ssize_t written = write(fd, pid.c_str(), pid.size());
+    close(fd);
+    return written == static_cast<ssize_t>(pid.size());
+}
+
+int main(int argc, char* argv[]) {
+    bool show_status = false;
+    int tick_report_interval = -1;
+    std::string config_file;
+
+    static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"config", required_argument, 0, 'c'},
+        {"status", no_argument, 0, 's'},
+        {"tick-report", required_argument, 0, 'T'},
+        {0, 0, 0, 0}
+    };
+
+    int option_index = 0;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "hc:sT:", long_options, &option_index)) != -1) {
+        switch (c) {
+            case 'h':
+                print_usage();
+                return 0;
+            case 'c':
+                config_file = optarg;
+                break;
+            case 's':
+                show_status = true;
+                break;
+            case 'T':
+                tick_report_interval = std::atoi(optarg);
+                if (tick_report_interval < 0) {
+                    std::cerr << "Error: Invalid tick report interval" << std::endl;
+                    return 1;
+                }
+                break;
+            case '?':
+                std::cerr << "Use -h for help" << std::endl;
+                return 1;
+            default:
+                break;
+        }
+    }
+
+    if (geteuid() != 0) {
+        std::cerr << "Error: This program requires root privileges" << std::endl;
+        return 1;
+    }
+
+    if (!show_status && !acquire_lock()) {
+        std::cerr << "ugreen-diskiomon already running!" << std::endl;
+        return 1;
+    }
+
+    int rc = 0;
+
+    try {
+        monitor_instance = std::make_unique<DiskIoMonitor>();
+        monitor_instance->loadConfig(config_file);
+
+        if (tick_report_interval >= 0) {
+            DiskIoMonitorConfig config = monitor_instance->getConfig();
+            config.tick_report_interval = tick_report_interval;
+            monitor_instance->setConfig(config);
+        }
+
+        if (show_status) {
+            // the LEDs of a running daemon are left alone
+            rc = monitor_instance->showStatus() ? 0 : 1;
+        } else if (!monitor_instance->initialize()) {
+            std::cerr << "Error: Failed to initialize monitor" << std::endl;
+            rc = 1;
+        } else {
+            signal(SIGINT, signal_handler);
+            signal(SIGTERM, signal_handler);
+            signal(SIGUSR1, signal_handler);
+
+            monitor_instance->startMonitoring();
+            std::cout << "Monitor shutdown complete." << std::endl;
+        }
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        rc = 1;
+    }
+
+    monitor_instance.reset();
+
+    if (!show_status) {
+        unlink(DISKIOMON_LOCK_FILE);
+    }
+
+    return rc;
+}
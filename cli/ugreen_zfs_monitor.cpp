@@ -1,5 +1,10 @@
 #include "zfs_monitor.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
 #include <csignal>
 #include <cstdlib>
 #include <unistd.h>
@@ -33,9 +38,14 @@ void printUsage(const char* program_name) {
     std::cout << "    -p, --pools-only        Monitor pools only (not individual disks)\n";
     std::cout << "    -d, --disks-only        Monitor disks only (not pool status)\n";
     std::cout << "    -t, --test              Run one test cycle and exit\n";
+    std::cout << "    -e, --events            Follow zpool events instead of polling\n";
     std::cout << "    -s, --status            Show current monitor status and exit\n";
     std::cout << "    -c, --config FILE       Use specific config file\n";
-    std::cout << "    -v, --version           Show version information\n\n";
+    std::cout << "    -v, --version           Show version information\n";
+    std::cout << "    -P, --parse-status FILE Print the vdev tree parsed from a saved\n";
+    std::cout << "                            `zpool status -P -L -p` output (- for stdin)\n";
+    std::cout << "    -B, --benchmark-parser  Time the zpool status parser on generated pools\n";
+    std::cout << "    -l, --read-label DEVICE Print the ZFS label of a device or image file\n\n";
     std::cout << "ZFS MONITORING FEATURES:\n";
     std::cout << "    - Pool health status (ONLINE, DEGRADED, FAULTED)\n";
     std::cout << "    - Scrub and resilver progress monitoring\n";
@@ -94,25 +104,185 @@ bool checkZfsAvailability() {
     return true;
 }
 
+// Print a vdev and its children, indented like `zpool status`
+void printVdev(const ZfsVdev& vdev, int depth) {
+    std::cout << std::string(2 + depth * 2, ' ') << std::left << std::setw(40 - depth * 2) << vdev.name
+              << std::setw(10) << (vdev.state.empty() ? "-" : vdev.state)
+              << " R " << vdev.read_errors << " W " << vdev.write_errors << " C " << vdev.checksum_errors;
+    if (!vdev.vdev_class.empty()) {
+        std::cout << "  [" << vdev.vdev_class << "]";
+    }
+    if (!vdev.note.empty()) {
+        std::cout << "  " << vdev.note;
+    }
+    std::cout << "\n";
+    
+    for (const auto& child : vdev.children) {
+        printVdev(child, depth + 1);
+    }
+}
+
+// Print the pools parsed from a saved `zpool status` output
+int parseStatusFile(const std::string& file) {
+    std::ostringstream buffer;
+    if (file == "-") {
+        buffer << std::cin.rdbuf();
+    } else {
+        std::ifstream input(file);
+        if (!input) {
+            std::cerr << "Error: Cannot read " << file << std::endl;
+            return 1;
+        }
+        buffer << input.rdbuf();
+    }
+    
+    static const char* scan_types[] = {"none", "scrub", "resilver"};
+    for (const auto& pool : parseZpoolStatus(buffer.str())) {
+        std::cout << "pool " << pool.name << " state " << pool.state << " errors " << pool.errors << "\n";
+        std::cout << "  scan " << scan_types[static_cast<int>(pool.scan.type)]
+                  << (pool.scan.in_progress ? " in progress" : "")
+                  << (pool.scan.canceled ? " canceled" : "");
+        if (pool.scan.percent_done >= 0) {
+            std::cout << " " << pool.scan.percent_done << "% done";
+        }
+        if (!pool.scan.repaired.empty()) {
+            std::cout << " repaired " << pool.scan.repaired;
+        }
+        std::cout << " errors " << pool.scan.errors << "\n";
+        if (pool.scan.in_progress) {
+            std::cout << "  progress scanned " << pool.scan.bytes_scanned << " issued " << pool.scan.bytes_issued
+                      << " total " << pool.scan.bytes_total << " rate " << pool.scan.rate << "/s eta "
+                      << pool.scan.eta_seconds << "s\n";
+        }
+        
+        for (const auto& vdev : pool.vdevs) {
+            printVdev(vdev, 0);
+        }
+    }
+    return 0;
+}
+
+// Print the pool and vdev from the ZFS label of a device or image file
+int readLabel(const std::string& device) {
+    ZfsLabelReader reader;
+    const ZfsVdevLabel& label = reader.read(device);
+    if (!label.valid) {
+        std::cerr << "No ZFS label found on " << device << std::endl;
+        return 1;
+    }
+    
+    std::cout << "pool:       " << (label.pool_name.empty() ? "-" : label.pool_name) << "\n";
+    std::cout << "pool guid:  " << label.pool_guid << "\n";
+    std::cout << "vdev guid:  " << label.vdev_guid << "\n";
+    std::cout << "txg:        " << label.txg << "\n";
+    std::cout << "pool state: " << label.pool_state << "\n";
+    return 0;
+}
+
+// `zpool status -P -L -p` of a pool of raidz2 groups of 8 disks, with a
+// special mirror, a cache and a spare, during a resilver
+std::string generateStatusFixture(int leaves) {
+    std::ostringstream out;
+    out << "  pool: tank\n"
+        << " state: DEGRADED\n"
+        << "status: One or more devices is currently being resilvered.  The pool will\n"
+        << "\tcontinue to function, possibly in a degraded state.\n"
+        << "action: Wait for the resilver to complete.\n"
+        << "  scan: resilver in progress since Sun Oct 18 10:00:00 2026\n"
+        << "\t1.23T scanned at 500M/s, 800G issued at 300M/s, 40.0T total\n"
+        << "\t200G resilvered, 2.00% done, 1 days 12:00:00 to go\n"
+        << "config:\n\n"
+        << "\tNAME                        STATE     READ WRITE CKSUM\n"
+        << "\ttank                        DEGRADED     0     0     0\n";
+    
+    int disk = 0;
+    auto device = [&disk]() {
+        std::string name;
+        int n = disk++;
+        do {
+            name.insert(name.begin(), static_cast<char>('a' + n % 26));
+            n = n / 26 - 1;
+        } while (n >= 0);
+        return "/dev/sd" + name + "1";
+    };
+    
+    for (int group = 0; disk < leaves; group++) {
+        out << "\t  raidz2-" << group << "                  ONLINE       0     0     0\n";
+        for (int i = 0; i < 8 && disk < leaves; i++) {
+            out << "\t    " << std::left << std::setw(24) << device()
+                << "ONLINE       0     0     " << (disk % 7 == 0 ? 3 : 0) << "\n";
+        }
+    }
+    
+    out << "\tspecial\n"
+        << "\t  mirror-" << (leaves + 7) / 8 << "                  ONLINE       0     0     0\n"
+        << "\t    /dev/nvme0n1p1          ONLINE       0     0     0\n"
+        << "\t    /dev/nvme1n1p1          ONLINE       0     0     0\n"
+        << "\tcache\n"
+        << "\t  /dev/nvme2n1p1            ONLINE       0     0     0\n"
+        << "\tspares\n"
+        << "\t  /dev/sdzz1                AVAIL\n"
+        << "\nerrors: No known data errors\n";
+    return out.str();
+}
+
+// Time the parser on growing pools, the time per line stays flat as it is linear
+int benchmarkParser() {
+    std::cout << std::right << std::setw(8) << "leaves" << std::setw(8) << "lines" << std::setw(10) << "bytes"
+              << std::setw(10) << "runs" << std::setw(14) << "us/parse" << std::setw(12) << "ns/line" << "\n";
+    
+    for (int leaves : {8, 64, 256, 512, 1024}) {
+        std::string fixture = generateStatusFixture(leaves);
+        size_t lines = std::count(fixture.begin(), fixture.end(), '\n');
+        
+        uint64_t runs = 0;
+        size_t parsed_vdevs = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration elapsed{};
+        do {
+            std::vector<ZfsPoolInfo> pools = parseZpoolStatus(fixture);
+            parsed_vdevs = pools.empty() ? 0 : pools[0].vdevs.size();
+            runs++;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed < std::chrono::milliseconds(200));
+        
+        if (parsed_vdevs != static_cast<size_t>((leaves + 7) / 8 + 3)) {
+            std::cerr << "Error: Parsed " << parsed_vdevs << " top level vdevs for " << leaves << " leaves" << std::endl;
+            return 1;
+        }
+        
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+        std::cout << std::setw(8) << leaves << std::setw(8) << lines << std::setw(10) << fixture.size()
+                  << std::setw(10) << runs << std::setw(14) << std::fixed << std::setprecision(1) << ns / 1000
+                  << std::setw(12) << ns / lines << "\n";
+    }
+    return 0;
+}
+
 // Parse command line arguments
 bool parseArguments(int argc, char* argv[], ZfsMonitorConfig& config, 
-                   bool& test_mode, bool& show_status, std::string& config_file) {
+                   bool& test_mode, bool& show_status, std::string& config_file,
+                   std::string& parse_file, bool& benchmark, std::string& label_device) {
     const struct option long_options[] = {
         {"help",        no_argument,       0, 'h'},
         {"interval",    required_argument, 0, 'i'},
         {"pools-only",  no_argument,       0, 'p'},
         {"disks-only",  no_argument,       0, 'd'},
         {"test",        no_argument,       0, 't'},
+        {"events",      no_argument,       0, 'e'},
         {"status",      no_argument,       0, 's'},
         {"config",      required_argument, 0, 'c'},
         {"version",     no_argument,       0, 'v'},
+        {"parse-status", required_argument, 0, 'P'},
+        {"benchmark-parser", no_argument,  0, 'B'},
+        {"read-label",  required_argument, 0, 'l'},
         {0, 0, 0, 0}
     };
     
     int option_index = 0;
     int c;
     
-    while ((c = getopt_long(argc, argv, "hi:pdtsc:v", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "hi:pdtesc:vP:Bl:", long_options, &option_index)) != -1) {
         switch (c) {
             case 'h':
                 printUsage(argv[0]);
@@ -144,6 +314,10 @@ bool parseArguments(int argc, char* argv[], ZfsMonitorConfig& config,
                 test_mode = true;
                 break;
                 
+            case 'e':
+                config.event_mode = true;
+                break;
+                
             case 's':
                 show_status = true;
                 break;
@@ -156,6 +330,18 @@ bool parseArguments(int argc, char* argv[], ZfsMonitorConfig& config,
                 printVersion();
                 return false;
                 
+            case 'P':
+                parse_file = optarg;
+                break;
+                
+            case 'B':
+                benchmark = true;
+                break;
+                
+            case 'l':
+                label_device = optarg;
+                break;
+                
             case '?':
                 std::cerr << "Unknown option. Use -h for help." << std::endl;
                 return false;
@@ -185,12 +371,26 @@ int main(int argc, char* argv[]) {
     bool test_mode = false;
     bool show_status = false;
     std::string config_file;
+    std::string parse_file;
+    bool benchmark = false;
+    std::string label_device;
     
-    if (!parseArguments(argc, argv, config, test_mode, show_status, config_file)) {
+    if (!parseArguments(argc, argv, config, test_mode, show_status, config_file, parse_file, benchmark, label_device)) {
         return (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help" ||
                             std::string(argv[1]) == "-v" || std::string(argv[1]) == "--version")) ? 0 : 1;
     }
     
+    // Parser and label tools, which need neither root nor ZFS
+    if (!parse_file.empty()) {
+        return parseStatusFile(parse_file);
+    }
+    if (benchmark) {
+        return benchmarkParser();
+    }
+    if (!label_device.empty()) {
+        return readLabel(label_device);
+    }
+    
     // Check prerequisites
     if (!checkRootPrivileges()) {
         return 1;
@@ -0,0 +1,189 @@
+#include "zfs_monitor.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Follows `zpool events -f -H -v`. Every event is a line with its time and
+// class, then one indented "name = value" line per member, and a blank line:
+//
+// Oct 18 2026 10:00:00.123456789	resource.fs.zfs.statechange
+//         class = "resource.fs.zfs.statechange"
+//         pool = "tank"
+//         vdev_path = "/dev/sda1"
+//         time = 0x68f36720 0x75bcd15
+
+bool ZfsEvent::changesPoolState() const {
+    // The last part of the class, e.g. statechange or scrub_finish
+    std::string kind = event_class.substr(event_class.find_last_of('.') + 1);
+
+    static const char* kinds[] = {
+        "statechange", "removed", "checksum", "io", "data", "probe_failure",
+        "scrub_start", "scrub_finish", "scrub_abort", "scrub_paused", "scrub_resume",
+        "resilver_start", "resilver_finish", "vdev_add", "vdev_attach", "vdev_remove",
+        "vdev_clear", "vdev_online", "vdev_spare", "config_sync",
+        "pool_import", "pool_export", "pool_destroy"
+    };
+    for (const char* k : kinds) {
+        if (kind == k) {
+            return true;
+        }
+    }
+
+    // ereport.fs.zfs.vdev.* report a vdev that could not be opened
+    return event_class.find(".vdev.") != std::string::npos;
+}
+
+ZfsEventStream::~ZfsEventStream() {
+    close();
+}
+
+bool ZfsEventStream::open() {
+    close();
+
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        ::close(pipe_fds[0]);
+        ::close(pipe_fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        int null_fd = ::open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDERR_FILENO);
+        }
+        execlp("zpool", "zpool", "events", "-f", "-H", "-v", static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    ::close(pipe_fds[1]);
+    fd_ = pipe_fds[0];
+    pid_ = pid;
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+
+    partial_.clear();
+    current_ = ZfsEvent();
+    in_event_ = false;
+    return true;
+}
+
+void ZfsEventStream::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    if (pid_ > 0) {
+        kill(pid_, SIGTERM);
+        waitpid(pid_, nullptr, 0);
+        pid_ = -1;
+    }
+}
+
+bool ZfsEventStream::read(std::vector<ZfsEvent>& events) {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    char buffer[4096];
+    for (;;) {
+        ssize_t len = ::read(fd_, buffer, sizeof(buffer));
+        if (len > 0) {
+            feed(std::string_view(buffer, len), events);
+        } else if (len < 0 && errno == EINTR) {
+            continue;
+        } else if (len < 0 && errno == EAGAIN) {
+            return true;
+        } else {
+            // zpool exited, e.g. when the zfs module was unloaded
+            finishEvent(events);
+            close();
+            return false;
+        }
+    }
+}
+
+void ZfsEventStream::feed(std::string_view data, std::vector<ZfsEvent>& events) {
+    while (!data.empty()) {
+        size_t eol = data.find('\n');
+        if (eol == std::string_view::npos) {
+            // Keep the start of a line until the rest of it arrives
+            partial_.append(data);
+            return;
+        }
+
+        std::string_view line = data.substr(0, eol);
+        data.remove_prefix(eol + 1);
+        if (!partial_.empty()) {
+            partial_.append(line);
+            parseLine(partial_, events);
+            partial_.clear();
+        } else {
+            parseLine(line, events);
+        }
+    }
+}
+
+void ZfsEventStream::parseLine(std::string_view line, std::vector<ZfsEvent>& events) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string_view::npos) {
+        finishEvent(events);
+        return;
+    }
+
+    // A line that is not indented starts the next event, its class is the last field
+    if (start == 0) {
+        finishEvent(events);
+        size_t separator = line.find_last_of(" \t");
+        if (separator == std::string_view::npos || line.substr(0, 4) == "TIME") {
+            return;
+        }
+        current_.event_class = std::string(line.substr(separator + 1));
+        in_event_ = true;
+        return;
+    }
+
+    if (!in_event_) {
+        return;
+    }
+
+    line.remove_prefix(start);
+    size_t equals = line.find(" = ");
+    if (equals == std::string_view::npos) {
+        return;
+    }
+    std::string_view key = line.substr(0, equals);
+    std::string_view value = line.substr(equals + 3);
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+    }
+
+    if (key == "pool") {
+        current_.pool = std::string(value);
+    } else if (key == "vdev_path") {
+        current_.vdev_path = std::string(value);
+    } else if (key == "time") {
+        // seconds and nanoseconds, in hex
+        current_.time = std::strtoull(std::string(value.substr(0, value.find(' '))).c_str(), nullptr, 16);
+    }
+}
+
+void ZfsEventStream::finishEvent(std::vector<ZfsEvent>& events) {
+    if (in_event_) {
+        events.push_back(std::move(current_));
+    }
+    current_ = ZfsEvent();
+    in_event_ = false;
+}
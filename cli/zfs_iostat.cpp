@@ -0,0 +1,201 @@
+#include "zfs_monitor.h"
+#include <algorithm>
+#include <cstdlib>
+
+// Latency of the leaf vdevs from `zpool iostat -v -l`. With -H every vdev is
+// a tab separated line without indentation, with -p the wait times are in
+// nanoseconds and "-" when there was no I/O:
+//
+// name  alloc  free  ops r/w  bandwidth r/w  total_wait r/w  disk_wait r/w  ...
+//
+// The tree of the vdevs is taken from `zpool status` instead, whose leaves
+// have the same names with -P and -L.
+
+namespace {
+
+constexpr size_t DISK_WAIT_READ = 9;
+constexpr size_t DISK_WAIT_WRITE = 10;
+
+// Weight of the latest sample in the moving averages
+constexpr double EWMA_WEIGHT = 0.3;
+
+// A leaf is slow when its average wait is this many times the median of the
+// other leaves of its parent, and at least SLOW_MIN_MS above it. The minimum
+// keeps idle disks with a few ms of jitter from being flagged.
+constexpr double SLOW_FACTOR = 3.0;
+constexpr double SLOW_MIN_MS = 25.0;
+constexpr int SLOW_MIN_SAMPLES = 3;
+
+bool parseWait(std::string_view field, double& ms) {
+    if (field.empty() || field[0] < '0' || field[0] > '9') {
+        return false;
+    }
+    ms = std::strtod(std::string(field).c_str(), nullptr) / 1e6;
+    return true;
+}
+
+double median(std::vector<double>& values) {
+    size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    double upper = values[middle];
+    if (values.size() % 2 != 0) {
+        return upper;
+    }
+    return (upper + *std::max_element(values.begin(), values.begin() + middle)) / 2;
+}
+
+} // namespace
+
+bool ZfsLatencySampler::sample(ZfsCommandExecutor& executor, const std::vector<ZfsPoolInfo>& pools, int seconds) {
+    if (pools.empty()) {
+        slow_changed_ = false;
+        for (const auto& leaf : leaves_) {
+            slow_changed_ = slow_changed_ || leaf.second.slow;
+        }
+        leaves_.clear();
+        return false;
+    }
+
+    // -y leaves out the averages since the pool was imported, so the one
+    // report covers the next seconds only
+    std::string command = "zpool iostat -v -l -H -p -P -L -y";
+    for (const auto& pool : pools) {
+        command += " " + pool.name;
+    }
+    command += " " + std::to_string(seconds) + " 1 2>/dev/null";
+
+    std::string output = executor.executeCommand(command);
+    if (output.empty()) {
+        return false;
+    }
+    update(output, pools);
+    return true;
+}
+
+void ZfsLatencySampler::update(std::string_view iostat_output, const std::vector<ZfsPoolInfo>& pools) {
+    // Only the leaves still in the pools are kept
+    std::unordered_map<std::string, ZfsVdevLatency> leaves;
+    std::vector<const std::vector<ZfsVdev>*> groups;
+    for (const auto& pool : pools) {
+        collectLeaves(pool.vdevs, leaves, groups);
+    }
+    for (auto& leaf : leaves) {
+        auto previous = leaves_.find(leaf.first);
+        if (previous != leaves_.end()) {
+            leaf.second = previous->second;
+        }
+    }
+
+    while (!iostat_output.empty()) {
+        size_t eol = iostat_output.find('\n');
+        std::string_view line = iostat_output.substr(0, eol);
+        iostat_output.remove_prefix(eol == std::string_view::npos ? iostat_output.size() : eol + 1);
+
+        std::vector<std::string_view> fields;
+        while (!line.empty()) {
+            size_t tab = line.find('\t');
+            fields.push_back(line.substr(0, tab));
+            line.remove_prefix(tab == std::string_view::npos ? line.size() : tab + 1);
+        }
+        if (fields.size() <= DISK_WAIT_WRITE) {
+            continue;
+        }
+
+        auto leaf = leaves.find(std::string(fields[0]));
+        if (leaf == leaves.end()) {
+            continue;
+        }
+
+        ZfsVdevLatency& latency = leaf->second;
+        // A direction without I/O keeps its average
+        double read_ms, write_ms;
+        bool have_read = parseWait(fields[DISK_WAIT_READ], read_ms);
+        bool have_write = parseWait(fields[DISK_WAIT_WRITE], write_ms);
+        if (have_read) {
+            latency.read_ms = latency.samples == 0 ? read_ms : latency.read_ms + EWMA_WEIGHT * (read_ms - latency.read_ms);
+        }
+        if (have_write) {
+            latency.write_ms = latency.samples == 0 ? write_ms : latency.write_ms + EWMA_WEIGHT * (write_ms - latency.write_ms);
+        }
+        if (have_read || have_write) {
+            latency.samples++;
+        }
+    }
+
+    // Compare every leaf with the other leaves of the same parent and class
+    for (const auto* group : groups) {
+        for (const auto& vdev : *group) {
+            auto leaf = leaves.find(vdev.name);
+            if (!vdev.isLeaf() || leaf == leaves.end()) {
+                continue;
+            }
+            ZfsVdevLatency& latency = leaf->second;
+            latency.slow = false;
+            latency.peers_ms = 0;
+            if (latency.samples < SLOW_MIN_SAMPLES) {
+                continue;
+            }
+
+            // A leaf that never had reads or writes is no peer for them
+            std::vector<double> read_peers, write_peers;
+            for (const auto& sibling : *group) {
+                auto peer = leaves.find(sibling.name);
+                if (&sibling == &vdev || !sibling.isLeaf() || peer == leaves.end() ||
+                    peer->second.samples < SLOW_MIN_SAMPLES || sibling.vdev_class != vdev.vdev_class) {
+                    continue;
+                }
+                if (peer->second.read_ms > 0) {
+                    read_peers.push_back(peer->second.read_ms);
+                }
+                if (peer->second.write_ms > 0) {
+                    write_peers.push_back(peer->second.write_ms);
+                }
+            }
+
+            for (auto [wait_ms, peers] : {std::make_pair(latency.read_ms, &read_peers),
+                                          std::make_pair(latency.write_ms, &write_peers)}) {
+                if (peers->empty()) {
+                    continue;
+                }
+                double peers_ms = median(*peers);
+                if (wait_ms > peers_ms * SLOW_FACTOR && wait_ms - peers_ms >= SLOW_MIN_MS) {
+                    latency.slow = true;
+                    latency.peers_ms = peers_ms;
+                    break;
+                }
+            }
+        }
+    }
+
+    slow_changed_ = false;
+    for (const auto& leaf : leaves) {
+        auto previous = leaves_.find(leaf.first);
+        slow_changed_ = slow_changed_ || leaf.second.slow != (previous != leaves_.end() && previous->second.slow);
+    }
+    for (const auto& leaf : leaves_) {
+        slow_changed_ = slow_changed_ || (leaf.second.slow && leaves.find(leaf.first) == leaves.end());
+    }
+    leaves_ = std::move(leaves);
+}
+
+void ZfsLatencySampler::collectLeaves(const std::vector<ZfsVdev>& vdevs,
+                                      std::unordered_map<std::string, ZfsVdevLatency>& leaves,
+                                      std::vector<const std::vector<ZfsVdev>*>& groups) {
+    bool has_leaves = false;
+    for (const auto& vdev : vdevs) {
+        if (vdev.isLeaf()) {
+            leaves.emplace(vdev.name, ZfsVdevLatency());
+            has_leaves = true;
+        } else {
+            collectLeaves(vdev.children, leaves, groups);
+        }
+    }
+    if (has_leaves) {
+        groups.push_back(&vdevs);
+    }
+}
+
+const ZfsVdevLatency* ZfsLatencySampler::find(const std::string& vdev_path) const {
+    auto it = leaves_.find(vdev_path);
+    return it != leaves_.end() && it->second.samples > 0 ? &it->second : nullptr;
+}
@@ -0,0 +1,248 @@
+#include "zfs_monitor.h"
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+// On disk layout of the vdev labels, see vdev_impl.h of OpenZFS. There are
+// two labels at the start and two at the end of each device, every label
+// holds the config nvlist of the vdev in its vdev_phys_t.
+
+namespace {
+
+constexpr uint64_t LABEL_SIZE = 256 * 1024;
+constexpr uint64_t PHYS_OFFSET = 16 * 1024;     // after the blank space and the boot header
+constexpr size_t PHYS_SIZE = 112 * 1024;
+constexpr size_t ECK_SIZE = 40;                 // zio_eck_t at the end of vdev_phys_t
+constexpr uint64_t ECK_MAGIC = 0x0210da7ab10c7a11ULL;
+
+constexpr uint8_t NV_ENCODE_XDR = 1;
+constexpr uint32_t DATA_TYPE_UINT64 = 8;
+constexpr uint32_t DATA_TYPE_STRING = 9;
+
+// XDR is big endian and aligned to 4 bytes
+class XdrReader {
+public:
+    XdrReader(const uint8_t* data, size_t size) : data_(data), size_(size), pos_(0) {}
+
+    size_t position() const { return pos_; }
+
+    bool seek(size_t pos) {
+        if (pos > size_) {
+            return false;
+        }
+        pos_ = pos;
+        return true;
+    }
+
+    bool readUint32(uint32_t& value) {
+        if (size_ - pos_ < 4) {
+            return false;
+        }
+        value = (uint32_t(data_[pos_]) << 24) | (uint32_t(data_[pos_ + 1]) << 16) |
+                (uint32_t(data_[pos_ + 2]) << 8) | uint32_t(data_[pos_ + 3]);
+        pos_ += 4;
+        return true;
+    }
+
+    bool readUint64(uint64_t& value) {
+        uint32_t high, low;
+        if (!readUint32(high) || !readUint32(low)) {
+            return false;
+        }
+        value = (uint64_t(high) << 32) | low;
+        return true;
+    }
+
+    bool readString(std::string& value) {
+        uint32_t len;
+        if (!readUint32(len) || len > size_ - pos_) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(data_ + pos_), len);
+        pos_ += (len + 3) & ~3u;
+        return pos_ <= size_;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_;
+};
+
+uint64_t readLittle64(const uint8_t* data) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+uint64_t byteSwap64(uint64_t value) {
+    return __builtin_bswap64(value);
+}
+
+std::string readSysfsValue(const std::string& path) {
+    std::ifstream file(path);
+    std::string value;
+    std::getline(file, value);
+    return value;
+}
+
+} // namespace
+
+bool ZfsLabelReader::decodeLabel(const uint8_t* data, size_t size, ZfsVdevLabel& label) {
+    label = ZfsVdevLabel();
+    if (size < PHYS_SIZE) {
+        return false;
+    }
+
+    // The magic of the embedded checksum is written in the byte order of the host
+    uint64_t magic = readLittle64(data + PHYS_SIZE - ECK_SIZE);
+    if (magic != ECK_MAGIC && byteSwap64(magic) != ECK_MAGIC) {
+        return false;
+    }
+
+    // nvs_header_t: encoding, endian and two reserved bytes
+    if (data[0] != NV_ENCODE_XDR) {
+        return false;
+    }
+
+    XdrReader xdr(data + 4, PHYS_SIZE - ECK_SIZE - 4);
+    uint32_t version, flags;
+    if (!xdr.readUint32(version) || !xdr.readUint32(flags)) {
+        return false;
+    }
+
+    // Each pair starts with its encoded size, which lets nested nvlists like
+    // vdev_tree be skipped without decoding them. Two zero sizes end the list.
+    bool have_guid = false;
+    for (;;) {
+        size_t start = xdr.position();
+        uint32_t encoded_size, decoded_size;
+        if (!xdr.readUint32(encoded_size) || !xdr.readUint32(decoded_size)) {
+            return false;
+        }
+        if (encoded_size == 0 && decoded_size == 0) {
+            break;
+        }
+        if (encoded_size < 20) {
+            return false;
+        }
+
+        std::string name;
+        uint32_t type, count;
+        if (!xdr.readString(name) || !xdr.readUint32(type) || !xdr.readUint32(count)) {
+            return false;
+        }
+
+        if (count == 1 && type == DATA_TYPE_UINT64) {
+            uint64_t value;
+            if (!xdr.readUint64(value)) {
+                return false;
+            }
+            if (name == "pool_guid") {
+                label.pool_guid = value;
+            } else if (name == "guid") {
+                label.vdev_guid = value;
+                have_guid = true;
+            } else if (name == "txg") {
+                label.txg = value;
+            } else if (name == "state") {
+                label.pool_state = value;
+            }
+        } else if (count == 1 && type == DATA_TYPE_STRING && name == "name") {
+            if (!xdr.readString(label.pool_name)) {
+                return false;
+            }
+        }
+
+        if (!xdr.seek(start + encoded_size)) {
+            return false;
+        }
+    }
+
+    label.valid = have_guid;
+    return label.valid;
+}
+
+ZfsVdevLabel ZfsLabelReader::readLabel(int fd, uint64_t size) {
+    ZfsVdevLabel newest;
+
+    // The labels at the end are placed from the size rounded down to a label
+    size -= size % LABEL_SIZE;
+    if (size < 4 * LABEL_SIZE) {
+        return newest;
+    }
+
+    const uint64_t offsets[] = {0, LABEL_SIZE, size - 2 * LABEL_SIZE, size - LABEL_SIZE};
+    std::vector<uint8_t> phys(PHYS_SIZE);
+
+    for (uint64_t offset : offsets) {
+        ZfsVdevLabel label;
+        ssize_t got = pread(fd, phys.data(), PHYS_SIZE, offset + PHYS_OFFSET);
+        if (got != static_cast<ssize_t>(PHYS_SIZE) || !decodeLabel(phys.data(), PHYS_SIZE, label)) {
+            continue;
+        }
+
+        // A label that was not rewritten by the last config change is older
+        if (!newest.valid || label.txg > newest.txg) {
+            newest = label;
+        }
+    }
+
+    return newest;
+}
+
+const ZfsVdevLabel& ZfsLabelReader::read(const std::string& device) {
+    static const ZfsVdevLabel none;
+
+    struct stat st;
+    if (stat(device.c_str(), &st) != 0) {
+        cache_.erase(device);
+        return none;
+    }
+
+    // Keep the label until the device is replaced or resized, so that labels
+    // are not read again from disks that may be spun down. The disk sequence
+    // number (Linux 5.15) changes whenever a disk is attached again.
+    std::string change_key = std::to_string(st.st_rdev) + ":" + std::to_string(st.st_size);
+    if (S_ISBLK(st.st_mode)) {
+        std::string name = device.substr(device.find_last_of('/') + 1);
+        std::string sys_path = "/sys/class/block/" + name;
+        change_key += ":" + readSysfsValue(sys_path + "/size");
+        std::string diskseq = readSysfsValue(sys_path + "/diskseq");
+        if (diskseq.empty()) {
+            diskseq = readSysfsValue(sys_path + "/../diskseq");
+        }
+        change_key += ":" + diskseq;
+    } else {
+        change_key += ":" + std::to_string(st.st_mtime);
+    }
+
+    auto it = cache_.find(device);
+    if (it != cache_.end() && it->second.change_key == change_key) {
+        return it->second.label;
+    }
+
+    CachedLabel& cached = cache_[device];
+    cached.change_key = change_key;
+    cached.label = ZfsVdevLabel();
+
+    int fd = open(device.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return cached.label;
+    }
+
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (S_ISBLK(st.st_mode) && ioctl(fd, BLKGETSIZE64, &size) != 0) {
+        size = 0;
+    }
+    cached.label = readLabel(fd, size);
+    close(fd);
+
+    return cached.label;
+}
@@ -6,10 +6,18 @@
 #include <sstream>
 #include <algorithm>
 #include <cstdlib>
+#include <cstdio>
 #include <unistd.h>
+#include <climits>
+#include <dirent.h>
+#include <fcntl.h>
+#include <cstring>
+#include <sys/stat.h>
 #include <regex>
 #include <thread>
 #include <sys/wait.h>
+#include <poll.h>
+#include <set>
 #include <chrono>
 
 // Default Configuration Constructor
@@ -19,10 +27,13 @@ ZfsMonitorConfig::ZfsMonitorConfig() :
     monitor_zfs_pools(true),
     monitor_zfs_disks(true),
     monitor_scrub_status(true),
+    monitor_slow_disks(true),
     turn_off_leds_on_exit(false),
     pool_status_led("power"),
     network_led("netdev"),
     mapping_method("ata"),
+    event_mode(false),
+    reconcile_interval(600),
     color_online(0, 255, 0),        // Green
     color_degraded(255, 255, 0),    // Yellow
     color_faulted(255, 0, 0),       // Red
@@ -30,7 +41,9 @@ ZfsMonitorConfig::ZfsMonitorConfig() :
     color_scrub_active(255, 128, 0), // Orange
     color_resilver(0, 255, 255),    // Cyan
     color_scrub_progress(128, 0, 255), // Purple
-    color_offline(64, 64, 64)       // Gray
+    color_offline(64, 64, 64),      // Gray
+    color_disk_errors(255, 64, 0),  // Red-orange, breathing
+    color_disk_slow(255, 0, 255)    // Magenta, blinking
 {
 }
 
@@ -87,6 +100,56 @@ std::vector<std::string> ZfsCommandExecutor::getPoolList() {
     return pools;
 }
 
+ZfsPoolHealth ZfsCommandExecutor::parseHealth(const std::string& health) {
+    if (health == "ONLINE") {
+        return ZfsPoolHealth::ONLINE;
+    } else if (health == "DEGRADED") {
+        return ZfsPoolHealth::DEGRADED;
+    } else if (health == "FAULTED") {
+        return ZfsPoolHealth::FAULTED;
+    } else if (health == "UNAVAIL") {
+        return ZfsPoolHealth::UNAVAIL;
+    }
+    return ZfsPoolHealth::UNKNOWN;
+}
+
+// Derive the scrub / resilver state of a pool from its `zpool status` output
+void ZfsCommandExecutor::applyStatusOutput(ZfsPoolInfo& info, const std::string& status_output) {
+    for (const auto& parsed : parseZpoolStatus(status_output)) {
+        if (parsed.name == info.name) {
+            applyParsedStatus(info, parsed);
+            break;
+        }
+    }
+}
+
+void ZfsCommandExecutor::applyParsedStatus(ZfsPoolInfo& info, const ZfsPoolInfo& parsed) {
+    info.state = parsed.state;
+    info.scan = parsed.scan;
+    info.scan_status = parsed.scan_status;
+    info.vdevs = parsed.vdevs;
+    info.errors = parsed.errors;
+    
+    // Check for operations in progress
+    const ZfsScanInfo& scan = info.scan;
+    if (scan.in_progress && scan.type == ZfsScanInfo::Type::SCRUB) {
+        info.scrub_active = true;
+        info.health = ZfsPoolHealth::SCRUB_ACTIVE;
+    } else if (scan.in_progress && scan.type == ZfsScanInfo::Type::RESILVER) {
+        info.resilver_active = true;
+        info.health = ZfsPoolHealth::RESILVER_ACTIVE;
+    } else if (scan.type == ZfsScanInfo::Type::SCRUB && !scan.canceled) {
+        // A finished scrub that repaired data or found errors, "repaired 0B
+        // with 0 errors" (or "repaired 0" with -p) is healthy
+        if (scan.repaired_bytes > 0 || scan.errors > 0) {
+            info.scrub_errors = true;
+            if (info.health == ZfsPoolHealth::ONLINE) {
+                info.health = ZfsPoolHealth::SCRUB_ERRORS;
+            }
+        }
+    }
+}
+
 ZfsPoolInfo ZfsCommandExecutor::getPoolInfo(const std::string& pool_name) {
     ZfsPoolInfo info;
     info.name = pool_name;
@@ -98,67 +161,456 @@ ZfsPoolInfo ZfsCommandExecutor::getPoolInfo(const std::string& pool_name) {
     
     // Get pool health
     std::string health_cmd = "zpool list -H -o health " + pool_name + " 2>/dev/null";
-    std::string health_output = runCommand(health_cmd);
-    health_output = trimString(health_output);
+    info.health = parseHealth(trimString(runCommand(health_cmd)));
+    
+    // Get detailed status
+    applyStatusOutput(info, getPoolStatus(pool_name));
     
-    if (health_output == "ONLINE") {
-        info.health = ZfsPoolHealth::ONLINE;
-    } else if (health_output == "DEGRADED") {
-        info.health = ZfsPoolHealth::DEGRADED;
-    } else if (health_output == "FAULTED") {
-        info.health = ZfsPoolHealth::FAULTED;
-    } else if (health_output == "UNAVAIL") {
-        info.health = ZfsPoolHealth::UNAVAIL;
+    return info;
+}
+
+static ZfsPoolInfo emptyPoolInfo(const std::string& pool_name) {
+    ZfsPoolInfo info;
+    info.name = pool_name;
+    info.health = ZfsPoolHealth::UNKNOWN;
+    info.scrub_active = false;
+    info.resilver_active = false;
+    info.scrub_errors = false;
+    info.errors = 0;
+    return info;
+}
+
+ZfsSnapshot ZfsCommandExecutor::takeSnapshot(const std::vector<std::string>& pool_filter) {
+    ZfsSnapshot snapshot;
+    snapshot.taken_at = std::chrono::system_clock::now();
+    
+    // Names and health of all imported pools
+    std::map<std::string, ZfsPoolHealth> imported;
+    std::vector<std::string> imported_names;
+    std::istringstream list_stream(runCommand("zpool list -H -o name,health 2>/dev/null"));
+    std::string line;
+    while (std::getline(list_stream, line)) {
+        std::vector<std::string> fields = splitString(line, '\t');
+        if (fields.size() >= 2) {
+            imported[fields[0]] = parseHealth(fields[1]);
+            imported_names.push_back(fields[0]);
+        }
     }
     
-    // Get detailed status
-    std::string status_cmd = "zpool status " + pool_name + " 2>/dev/null";
-    std::string status_output = runCommand(status_cmd);
+    // Status of all pools at once, with full device paths and symlinks resolved
+    std::map<std::string, ZfsPoolInfo> parsed;
+    for (auto& pool : parseZpoolStatus(runCommand("zpool status -P -L -p 2>/dev/null"))) {
+        std::string pool_name = pool.name;
+        parsed[pool_name] = std::move(pool);
+    }
     
-    // Check for operations in progress
-    if (status_output.find("scrub in progress") != std::string::npos) {
-        info.scrub_active = true;
-        info.health = ZfsPoolHealth::SCRUB_ACTIVE;
-    } else if (status_output.find("resilver in progress") != std::string::npos) {
-        info.resilver_active = true;
-        info.health = ZfsPoolHealth::RESILVER_ACTIVE;
-    } else if (status_output.find("scrub repaired") != std::string::npos && 
-               status_output.find("with") != std::string::npos && 
-               status_output.find("errors") != std::string::npos) {
+    const std::vector<std::string>& pool_names = pool_filter.empty() ? imported_names : pool_filter;
+    for (const auto& pool_name : pool_names) {
+        ZfsPoolInfo info = emptyPoolInfo(pool_name);
         
-        // Parse the scrub line to check if actual data was repaired or errors were found
-        std::istringstream stream(status_output);
-        std::string line;
-        bool found_actual_errors = false;
+        // A configured pool that is not imported stays UNKNOWN
+        auto it = imported.find(pool_name);
+        if (it != imported.end()) {
+            info.health = it->second;
+            auto status = parsed.find(pool_name);
+            if (status != parsed.end()) {
+                applyParsedStatus(info, status->second);
+            }
+        }
         
-        while (std::getline(stream, line)) {
-            if (line.find("scrub repaired") != std::string::npos) {
-                // Look for patterns like "repaired 0B" (no errors) vs "repaired 123KB" (actual repairs)
-                if (line.find("repaired 0B") == std::string::npos) {
-                    // Non-zero repair amount indicates actual errors were found and fixed
-                    found_actual_errors = true;
-                    break;
-                }
-                // Also check for explicit error count
-                if (line.find("with 0 errors") == std::string::npos && 
-                    line.find("errors") != std::string::npos) {
-                    // Non-zero error count
-                    found_actual_errors = true;
+        snapshot.pools.push_back(info);
+    }
+    
+    snapshot.valid = true;
+    return snapshot;
+}
+
+void ZfsCommandExecutor::refreshPool(ZfsSnapshot& snapshot, const std::string& pool_name,
+                                     const std::vector<std::string>& pool_filter) {
+    // The name comes from an event and is passed to the shell
+    if (pool_name.empty() ||
+        pool_name.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-.:") != std::string::npos) {
+        return;
+    }
+    if (!pool_filter.empty() && std::find(pool_filter.begin(), pool_filter.end(), pool_name) == pool_filter.end()) {
+        return;
+    }
+    
+    ZfsPoolInfo info = emptyPoolInfo(pool_name);
+    std::string health = trimString(runCommand("zpool list -H -o health " + pool_name + " 2>/dev/null"));
+    if (!health.empty()) {
+        info.health = parseHealth(health);
+        for (const auto& parsed : parseZpoolStatus(runCommand("zpool status -P -L -p " + pool_name + " 2>/dev/null"))) {
+            if (parsed.name == pool_name) {
+                applyParsedStatus(info, parsed);
+            }
+        }
+    }
+    
+    auto it = std::find_if(snapshot.pools.begin(), snapshot.pools.end(),
+                           [&pool_name](const ZfsPoolInfo& pool) { return pool.name == pool_name; });
+    if (health.empty() && pool_filter.empty()) {
+        // Exported or destroyed, and not configured to be shown as UNKNOWN
+        if (it != snapshot.pools.end()) {
+            snapshot.pools.erase(it);
+        }
+    } else if (it != snapshot.pools.end()) {
+        *it = info;
+    } else {
+        snapshot.pools.push_back(info);
+    }
+    
+    snapshot.taken_at = std::chrono::system_clock::now();
+}
+
+const ZfsPoolInfo* ZfsSnapshot::findPool(const std::string& pool_name) const {
+    for (const auto& pool : pools) {
+        if (pool.name == pool_name) {
+            return &pool;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::pair<std::string, int64_t>> DevDiskIndex::directoryTimes() const {
+    std::vector<std::pair<std::string, int64_t>> times;
+    
+    DIR* dir = opendir("/dev/disk");
+    if (!dir) {
+        return times;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        struct stat st;
+        std::string path = std::string("/dev/disk/") + entry->d_name;
+        if (strncmp(entry->d_name, "by-", 3) == 0 && stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            times.emplace_back(path, static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec);
+        }
+    }
+    closedir(dir);
+    
+    // by-id names win over the other directories when a bare name is looked up
+    auto rank = [](const std::string& path) {
+        static const char* order[] = {"/dev/disk/by-id", "/dev/disk/by-vdev", "/dev/disk/by-partuuid", "/dev/disk/by-path"};
+        for (size_t i = 0; i < 4; i++) {
+            if (path == order[i]) {
+                return i;
+            }
+        }
+        return size_t(4);
+    };
+    std::sort(times.begin(), times.end(), [&rank](const auto& a, const auto& b) {
+        return rank(a.first) != rank(b.first) ? rank(a.first) < rank(b.first) : a.first < b.first;
+    });
+    return times;
+}
+
+void DevDiskIndex::refresh() {
+    // udev adds and removes links, which changes the time of their directory
+    std::vector<std::pair<std::string, int64_t>> times = directoryTimes();
+    if (times == dir_mtimes_) {
+        return;
+    }
+    
+    dir_mtimes_ = times;
+    targets_.clear();
+    aliases_.clear();
+    
+    for (const auto& [dir_path, mtime] : dir_mtimes_) {
+        int dir_fd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR* dir = dir_fd >= 0 ? fdopendir(dir_fd) : nullptr;
+        if (!dir) {
+            if (dir_fd >= 0) {
+                close(dir_fd);
+            }
+            continue;
+        }
+        
+        while (struct dirent* entry = readdir(dir)) {
+            char target[PATH_MAX];
+            ssize_t len = entry->d_name[0] == '.' ? -1 : readlinkat(dir_fd, entry->d_name, target, sizeof(target) - 1);
+            if (len <= 0) {
+                continue;
+            }
+            
+            // The links are relative, like ../../sda1
+            std::string device(target, len);
+            if (device[0] != '/') {
+                device = "/dev/" + device.substr(device.find_last_of('/') + 1);
+            }
+            
+            std::string link = dir_path + "/" + entry->d_name;
+            targets_[link] = device;
+            targets_.emplace(entry->d_name, device);
+            aliases_[device].push_back(link);
+        }
+        closedir(dir);
+    }
+}
+
+std::string DevDiskIndex::resolve(const std::string& link) const {
+    auto it = targets_.find(link);
+    return it == targets_.end() ? "" : it->second;
+}
+
+const std::vector<std::string>& DevDiskIndex::aliases(const std::string& device) const {
+    static const std::vector<std::string> none;
+    auto it = aliases_.find(device);
+    return it == aliases_.end() ? none : it->second;
+}
+
+// Whole disk of a block device, following partitions and the slaves of
+// dm / md devices (the first slave of a device spanning several disks)
+static std::string wholeDisk(const std::string& name, int depth = 0) {
+    std::string sys_path = "/sys/class/block/" + name;
+    char resolved[PATH_MAX];
+    
+    if (fileExists(sys_path + "/partition") && realpath(sys_path.c_str(), resolved)) {
+        std::string parent(resolved);
+        parent.erase(parent.find_last_of('/'));
+        return parent.substr(parent.find_last_of('/') + 1);
+    }
+    
+    if (depth < 4) {
+        DIR* slaves = opendir((sys_path + "/slaves").c_str());
+        if (slaves) {
+            std::string slave;
+            while (struct dirent* entry = readdir(slaves)) {
+                if (entry->d_name[0] != '.') {
+                    slave = entry->d_name;
                     break;
                 }
             }
+            closedir(slaves);
+            if (!slave.empty()) {
+                return wholeDisk(slave, depth + 1);
+            }
+        }
+    }
+    
+    return fileExists(sys_path) ? name : "";
+}
+
+// Kernel name of the disk that held a vdev which is gone now, from its last
+// path like /dev/sdc1 or /dev/nvme0n1p2
+static std::string formerDisk(const std::string& path) {
+    if (path.rfind("/dev/", 0) != 0 || path.rfind("/dev/disk/", 0) == 0) {
+        return "";
+    }
+    
+    std::string name = path.substr(5);
+    size_t end = name.find_last_not_of("0123456789") + 1;
+    if (name.rfind("nvme", 0) == 0) {
+        // nvme0n1p2 -> nvme0n1
+        return (end < name.size() && name[end - 1] == 'p') ? name.substr(0, end - 1) : name;
+    }
+    if (name.rfind("sd", 0) == 0 || name.rfind("vd", 0) == 0) {
+        // sdc1 -> sdc
+        return name.substr(0, end);
+    }
+    return "";
+}
+
+std::string ZfsDiskIndex::diskOfPath(const std::string& path, const DevDiskIndex& dev_disks) {
+    if (path.empty()) {
+        return "";
+    }
+    
+    // Without -P the vdevs are named by their link in one of the /dev/disk directories
+    std::string device = dev_disks.resolve(path);
+    if (device.empty()) {
+        char resolved[PATH_MAX];
+        std::string candidate = path[0] == '/' ? path : "/dev/" + path;
+        if (!realpath(candidate.c_str(), resolved)) {
+            return "";
+        }
+        device = resolved;
+    }
+    
+    return wholeDisk(device.substr(device.find_last_of('/') + 1));
+}
+
+ZfsDiskStatus ZfsDiskIndex::statusOfState(const std::string& state) {
+    if (state == "ONLINE" || state == "AVAIL" || state == "INUSE") {
+        return ZfsDiskStatus::ONLINE;
+    } else if (state == "DEGRADED") {
+        return ZfsDiskStatus::DEGRADED;
+    } else if (state == "FAULTED" || state == "OFFLINE" || state == "UNAVAIL" || state == "REMOVED") {
+        return ZfsDiskStatus::FAULTED;
+    }
+    return ZfsDiskStatus::UNKNOWN;
+}
+
+void ZfsDiskIndex::build(const std::vector<ZfsPoolInfo>& pools, const DevDiskIndex& dev_disks,
+                         const GuidMapBuilder& build_guid_map) {
+    by_disk_.clear();
+    build_guid_map_ = &build_guid_map;
+    guid_to_device_.reset();
+    
+    std::vector<std::pair<std::string, ZfsDiskVdev>> missing;
+    for (const auto& pool : pools) {
+        addLeaves(pool.name, pool.vdevs, dev_disks, missing);
+    }
+    build_guid_map_ = nullptr;
+    guid_to_device_.reset();
+    
+    // A vdev that is gone is only shown on the disk that had its name if no
+    // vdev that is present took that disk
+    for (const auto& [disk, vdev] : missing) {
+        if (by_disk_.find(disk) == by_disk_.end()) {
+            by_disk_[disk] = vdev;
+        }
+    }
+}
+
+// Disk whose label carries the guid, building the map of the labels once per build()
+std::string ZfsDiskIndex::diskOfGuid(const std::string& guid, const DevDiskIndex& dev_disks) {
+    if (!guid_to_device_) {
+        guid_to_device_ = std::make_unique<std::map<std::string, std::string>>(
+            build_guid_map_ ? (*build_guid_map_)() : std::map<std::string, std::string>());
+    }
+    
+    auto labeled = guid_to_device_->find(guid);
+    if (labeled == guid_to_device_->end()) {
+        return "";
+    }
+    return diskOfPath(labeled->second, dev_disks);
+}
+
+void ZfsDiskIndex::addLeaves(const std::string& pool, const std::vector<ZfsVdev>& vdevs, const DevDiskIndex& dev_disks,
+                             std::vector<std::pair<std::string, ZfsDiskVdev>>& missing) {
+    for (const auto& vdev : vdevs) {
+        if (!vdev.isLeaf()) {
+            addLeaves(pool, vdev.children, dev_disks, missing);
+            continue;
         }
         
-        if (found_actual_errors) {
-            info.scrub_errors = true;
-            if (info.health == ZfsPoolHealth::ONLINE) {
-                info.health = ZfsPoolHealth::SCRUB_ERRORS;
-            }
+        ZfsDiskVdev entry;
+        entry.pool = pool;
+        entry.vdev_path = vdev.name;
+        entry.vdev_class = vdev.vdev_class;
+        entry.state = vdev.state;
+        entry.status = statusOfState(vdev.state);
+        entry.read_errors = vdev.read_errors;
+        entry.write_errors = vdev.write_errors;
+        entry.checksum_errors = vdev.checksum_errors;
+        
+        std::string disk = diskOfPath(vdev.name, dev_disks);
+        if (disk.empty()) {
+            // A vdev that cannot be opened by its path is listed by its guid,
+            // which the label of a disk that is still present may carry
+            disk = diskOfGuid(vdev.name, dev_disks);
         }
-        // If scrub repaired 0B with 0 errors, this is actually healthy - don't flag as error
+        if (!disk.empty()) {
+            add(disk, entry);
+            continue;
+        }
+        
+        // Missing vdevs are listed by guid with a note "was /dev/sdc1"
+        std::string former = vdev.name;
+        if (vdev.note.rfind("was ", 0) == 0) {
+            former = vdev.note.substr(4);
+        }
+        disk = formerDisk(former);
+        if (!disk.empty()) {
+            missing.emplace_back(disk, entry);
+        }
+    }
+}
+
+void ZfsDiskIndex::add(const std::string& disk, const ZfsDiskVdev& vdev) {
+    auto it = by_disk_.find(disk);
+    if (it == by_disk_.end()) {
+        by_disk_[disk] = vdev;
+        return;
     }
     
-    return info;
+    // A disk with vdevs in several partitions shows the worst of them, and
+    // the errors of all of them
+    ZfsDiskVdev& existing = it->second;
+    uint64_t read_errors = existing.read_errors + vdev.read_errors;
+    uint64_t write_errors = existing.write_errors + vdev.write_errors;
+    uint64_t checksum_errors = existing.checksum_errors + vdev.checksum_errors;
+    if (existing.status == ZfsDiskStatus::UNKNOWN ||
+        (vdev.status != ZfsDiskStatus::UNKNOWN && vdev.status > existing.status)) {
+        existing = vdev;
+    }
+    existing.read_errors = read_errors;
+    existing.write_errors = write_errors;
+    existing.checksum_errors = checksum_errors;
+}
+
+const ZfsDiskVdev* ZfsDiskIndex::find(const std::string& disk) const {
+    std::string name = disk.rfind("/dev/", 0) == 0 ? disk.substr(5) : disk;
+    auto it = by_disk_.find(name);
+    return it == by_disk_.end() ? nullptr : &it->second;
+}
+
+bool DiskStatsSampler::sample() {
+    std::ifstream file("/proc/diskstats");
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - previous_at_).count();
+    bool have_previous = !previous_.empty() && seconds > 0;
+    
+    std::unordered_map<std::string, Counters> current;
+    rates_.clear();
+    
+    std::string line;
+    while (std::getline(file, line)) {
+        // major minor name reads merged sectors ms writes merged sectors ms in_flight io_ms ...
+        unsigned int major = 0, minor = 0;
+        char name[64];
+        unsigned long long fields[10];
+        if (sscanf(line.c_str(), "%u %u %63s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &major, &minor, name, &fields[0], &fields[1], &fields[2], &fields[3], &fields[4],
+                   &fields[5], &fields[6], &fields[7], &fields[8], &fields[9]) != 13) {
+            continue;
+        }
+        
+        Counters& counters = current[name];
+        counters.reads = fields[0];
+        counters.read_sectors = fields[2];
+        counters.read_ms = fields[3];
+        counters.writes = fields[4];
+        counters.write_sectors = fields[6];
+        counters.write_ms = fields[7];
+        counters.io_ms = fields[9];
+        
+        auto previous = previous_.find(name);
+        if (!have_previous || previous == previous_.end()) {
+            continue;
+        }
+        
+        // Counters going back belong to a device that was removed and added again
+        const Counters& last = previous->second;
+        if (counters.reads < last.reads || counters.writes < last.writes || counters.io_ms < last.io_ms) {
+            continue;
+        }
+        
+        uint64_t ios = (counters.reads - last.reads) + (counters.writes - last.writes);
+        DiskIoRates& rates = rates_[name];
+        rates.utilization = std::min(100.0, (counters.io_ms - last.io_ms) / (seconds * 10));
+        rates.reads_per_sec = (counters.reads - last.reads) / seconds;
+        rates.writes_per_sec = (counters.writes - last.writes) / seconds;
+        // diskstats counts sectors of 512 bytes, whatever the sector size of the disk
+        rates.read_bytes_per_sec = (counters.read_sectors - last.read_sectors) * 512.0 / seconds;
+        rates.write_bytes_per_sec = (counters.write_sectors - last.write_sectors) * 512.0 / seconds;
+        rates.await_ms = ios ? static_cast<double>((counters.read_ms - last.read_ms) +
+                                                    (counters.write_ms - last.write_ms)) / ios : 0;
+    }
+    
+    previous_ = std::move(current);
+    previous_at_ = now;
+    return true;
+}
+
+const DiskIoRates* DiskStatsSampler::rates(const std::string& disk) const {
+    std::string name = disk.substr(disk.find_last_of('/') + 1);
+    auto it = rates_.find(name);
+    return it == rates_.end() ? nullptr : &it->second;
 }
 
 std::string ZfsCommandExecutor::getPoolStatus(const std::string& pool_name) {
@@ -222,6 +674,26 @@ void DiskMapper::setSerialMap(const std::vector<std::string>& serials) {
     serial_map_ = serials;
 }
 
+std::string DiskMapper::findSataDisk(const std::function<bool(const std::string&)>& matches) {
+    DIR* dir = opendir("/sys/block");
+    if (!dir) {
+        return "";
+    }
+    
+    std::string device;
+    while (struct dirent* entry = readdir(dir)) {
+        std::string dev = entry->d_name;
+        if (dev.size() > 2 && dev.rfind("sd", 0) == 0 &&
+            dev.find_first_not_of("abcdefghijklmnopqrstuvwxyz", 2) == std::string::npos && matches(dev)) {
+            device = "/dev/" + dev;
+            break;
+        }
+    }
+    
+    closedir(dir);
+    return device;
+}
+
 std::string DiskMapper::getDiskDevice(int disk_index) {
     if (disk_index < 0 || disk_index >= 8) {
         return "";
@@ -232,30 +704,28 @@ std::string DiskMapper::getDiskDevice(int disk_index) {
     switch (mapping_method_) {
         case MappingMethod::ATA: {
             if (disk_index < static_cast<int>(ata_map_.size())) {
-                std::string ata_name = ata_map_[disk_index];
-                std::string cmd = "ls /sys/block/ 2>/dev/null | grep -E '^sd[a-z]+$'";
-                std::string block_devices = runCommand(cmd);
-                
-                std::istringstream iss(block_devices);
-                std::string dev;
-                while (std::getline(iss, dev)) {
-                    dev = trimString(dev);
-                    std::string link_cmd = "readlink /sys/block/" + dev + " 2>/dev/null";
-                    std::string link_output = runCommand(link_cmd);
-                    if (link_output.find(ata_name) != std::string::npos) {
-                        device = "/dev/" + dev;
-                        break;
-                    }
-                }
+                // The sysfs path of the disk runs through its ATA port, e.g. .../ata3/host2/...
+                std::string ata_port = "/" + ata_map_[disk_index] + "/";
+                device = findSataDisk([&ata_port](const std::string& dev) {
+                    char link[PATH_MAX];
+                    ssize_t len = readlink(("/sys/block/" + dev).c_str(), link, sizeof(link) - 1);
+                    return len > 0 && std::string(link, len).find(ata_port) != std::string::npos;
+                });
             }
             break;
         }
         
         case MappingMethod::HCTL: {
             if (disk_index < static_cast<int>(hctl_map_.size())) {
-                std::string hctl = hctl_map_[disk_index];
-                std::string cmd = "lsblk -S -o HCTL,NAME 2>/dev/null | awk '$1==\"" + hctl + "\" {print \"/dev/\"$2}'";
-                device = trimString(runCommand(cmd));
+                // The SCSI device of the disk is named by its HCTL, e.g. ../../../2:0:0:0
+                std::string hctl = "/" + hctl_map_[disk_index];
+                device = findSataDisk([&hctl](const std::string& dev) {
+                    char link[PATH_MAX];
+                    ssize_t len = readlink(("/sys/block/" + dev + "/device").c_str(), link, sizeof(link) - 1);
+                    std::string target(link, len > 0 ? len : 0);
+                    return target.size() >= hctl.size() &&
+                           target.compare(target.size() - hctl.size(), hctl.size(), hctl) == 0;
+                });
             }
             break;
         }
@@ -283,6 +753,8 @@ ZfsMonitor::ZfsMonitor() :
 {
     setDefaultConfig();
     led_names_ = {"disk1", "disk2", "disk3", "disk4", "disk5", "disk6", "disk7", "disk8"};
+    disks_.resize(led_names_.size());
+    disk_leds_.resize(led_names_.size());
 }
 
 ZfsMonitor::~ZfsMonitor() {
@@ -351,6 +823,16 @@ void ZfsMonitor::parseConfigLine(const std::string& line) {
         config_.monitor_zfs_disks = (value == "true");
     } else if (key == "MONITOR_SCRUB_STATUS") {
         config_.monitor_scrub_status = (value == "true");
+    } else if (key == "MONITOR_SLOW_DISKS") {
+        config_.monitor_slow_disks = (value == "true");
+    } else if (key == "ZFS_EVENT_MODE") {
+        config_.event_mode = (value == "true");
+    } else if (key == "ZFS_RECONCILE_INTERVAL") {
+        try {
+            config_.reconcile_interval = std::stoi(value);
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Invalid ZFS_RECONCILE_INTERVAL value '" << value << "', using default" << std::endl;
+        }
     } else if (key == "ZFS_POOLS") {
         config_.zfs_pools = splitString(value, ' ');
     } else if (key == "MAPPING_METHOD") {
@@ -361,6 +843,10 @@ void ZfsMonitor::parseConfigLine(const std::string& line) {
         config_.color_degraded = stringToColor(value);
     } else if (key == "COLOR_FAULTED") {
         config_.color_faulted = stringToColor(value);
+    } else if (key == "COLOR_DISK_ERRORS") {
+        config_.color_disk_errors = stringToColor(value);
+    } else if (key == "COLOR_DISK_SLOW") {
+        config_.color_disk_slow = stringToColor(value);
     }
     // Add more configuration parsing as needed
 }
@@ -410,58 +896,36 @@ std::vector<std::string> ZfsMonitor::getDeviceIdentifiers(const std::string& dev
     identifiers.push_back(device_name);
     identifiers.push_back(device_path);
     
-    // Find by-id links that point to this device
-    std::string by_id_cmd = "find /dev/disk/by-id -type l 2>/dev/null | while read link; do "
-                           "if [ \"$(readlink -f \"$link\")\" = \"" + device_path + "\" ]; then "
-                           "basename \"$link\"; fi; done";
-    std::string by_id_output = zfs_executor_->executeCommand(by_id_cmd);
-    
-    std::istringstream by_id_stream(by_id_output);
-    std::string by_id_link;
-    while (std::getline(by_id_stream, by_id_link)) {
-        by_id_link = trimString(by_id_link);
-        if (!by_id_link.empty()) {
-            identifiers.push_back(by_id_link);
-        }
+    // Names of the links pointing to the device and to each of its
+    // partitions, and the guid in the ZFS label of each of them
+    dev_disks_.refresh();
+    for (const auto& link : dev_disks_.aliases(device_path)) {
+        identifiers.push_back(link.substr(link.find_last_of('/') + 1));
     }
-    
-    // Find by-uuid links for partitions of this device
-    std::string by_uuid_cmd = "find /dev/disk/by-uuid -type l 2>/dev/null | while read link; do "
-                             "target=$(readlink -f \"$link\"); "
-                             "case \"$target\" in \"" + device_path + "\"*) "
-                             "basename \"$link\";; esac; done";
-    std::string by_uuid_output = zfs_executor_->executeCommand(by_uuid_cmd);
-    
-    std::istringstream by_uuid_stream(by_uuid_output);
-    std::string by_uuid_link;
-    while (std::getline(by_uuid_stream, by_uuid_link)) {
-        by_uuid_link = trimString(by_uuid_link);
-        if (!by_uuid_link.empty()) {
-            identifiers.push_back(by_uuid_link);
-        }
+    const ZfsVdevLabel& label = labels_.read(device_path);
+    if (label.valid) {
+        identifiers.push_back(std::to_string(label.vdev_guid));
     }
     
-    // Check for partitions of this device
-    for (int i = 1; i <= 9; i++) {
-        std::string partition = device_path + std::to_string(i);
-        if (fileExists(partition)) {
-            identifiers.push_back(partition.substr(partition.find_last_of('/') + 1));
-            
-            // Also get by-id links for partitions
-            std::string part_by_id_cmd = "find /dev/disk/by-id -type l 2>/dev/null | while read link; do "
-                                        "if [ \"$(readlink -f \"$link\")\" = \"" + partition + "\" ]; then "
-                                        "basename \"$link\"; fi; done";
-            std::string part_by_id_output = zfs_executor_->executeCommand(part_by_id_cmd);
+    DIR* dir = opendir(("/sys/class/block/" + device_name).c_str());
+    if (dir) {
+        while (struct dirent* entry = readdir(dir)) {
+            std::string partition = entry->d_name;
+            if (partition.rfind(device_name, 0) != 0 ||
+                !fileExists("/sys/class/block/" + device_name + "/" + partition + "/partition")) {
+                continue;
+            }
             
-            std::istringstream part_stream(part_by_id_output);
-            std::string part_link;
-            while (std::getline(part_stream, part_link)) {
-                part_link = trimString(part_link);
-                if (!part_link.empty()) {
-                    identifiers.push_back(part_link);
-                }
+            identifiers.push_back(partition);
+            for (const auto& link : dev_disks_.aliases("/dev/" + partition)) {
+                identifiers.push_back(link.substr(link.find_last_of('/') + 1));
+            }
+            const ZfsVdevLabel& partition_label = labels_.read("/dev/" + partition);
+            if (partition_label.valid) {
+                identifiers.push_back(std::to_string(partition_label.vdev_guid));
             }
         }
+        closedir(dir);
     }
     
     return identifiers;
@@ -492,6 +956,23 @@ void ZfsMonitor::cleanup() {
 bool ZfsMonitor::runSingleCheck() {
     std::cout << "=== ZFS Monitor check at " << getCurrentTimestamp() << " ===" << std::endl;
     
+    // All checks of this cycle read the same snapshot. Event mode samples
+    // the latency on its own timer.
+    snapshot_ = zfs_executor_->takeSnapshot(config_.zfs_pools);
+    updateFromSnapshot(!config_.event_mode);
+    
+    std::cout << std::endl;
+    return true;
+}
+
+void ZfsMonitor::updateFromSnapshot(bool sample_latency) {
+    dev_disks_.refresh();
+    disk_index_.build(snapshot_.pools, dev_disks_, [this] { return buildGuidToDeviceMap(); });
+    disk_stats_.sample();
+    if (sample_latency && config_.monitor_zfs_disks && config_.monitor_slow_disks) {
+        latency_.sample(*zfs_executor_, snapshot_.pools);
+    }
+    
     if (config_.monitor_zfs_pools) {
         monitorZfsPools();
     }
@@ -503,21 +984,29 @@ bool ZfsMonitor::runSingleCheck() {
     if (config_.monitor_scrub_status) {
         monitorScrubResilver();
     }
-    
-    std::cout << std::endl;
-    return true;
 }
 
 void ZfsMonitor::startMonitoring() {
     running_ = true;
     
     std::cout << "Starting UGREEN ZFS monitoring..." << std::endl;
-    std::cout << "Monitor interval: " << config_.monitor_interval << " seconds" << std::endl;
+    if (config_.event_mode) {
+        std::cout << "Event mode: following zpool events, full check every "
+                  << config_.reconcile_interval << " seconds" << std::endl;
+    } else {
+        std::cout << "Monitor interval: " << config_.monitor_interval << " seconds" << std::endl;
+    }
     std::cout << "Pool monitoring: " << (config_.monitor_zfs_pools ? "enabled" : "disabled") << std::endl;
     std::cout << "Disk monitoring: " << (config_.monitor_zfs_disks ? "enabled" : "disabled") << std::endl;
     std::cout << "Scrub monitoring: " << (config_.monitor_scrub_status ? "enabled" : "disabled") << std::endl;
+    std::cout << "Slow disk detection: " << (config_.monitor_slow_disks ? "enabled" : "disabled") << std::endl;
     std::cout << "Press Ctrl+C to stop" << std::endl << std::endl;
     
+    if (config_.event_mode) {
+        monitorEvents();
+        return;
+    }
+    
     while (running_) {
         runSingleCheck();
         
@@ -530,63 +1019,177 @@ void ZfsMonitor::startMonitoring() {
     }
 }
 
+void ZfsMonitor::monitorEvents() {
+    using std::chrono::steady_clock;
+    
+    // Events come in bursts, like the io ereports of a failing disk, and are
+    // handled together once no new one arrived for settle_time, but at most
+    // max_delay after the first one, so a steady stream still updates the LEDs
+    const auto settle_time = std::chrono::milliseconds(500);
+    const auto max_delay = std::chrono::seconds(2);
+    
+    // `zpool events -f` first replays the events ZFS still remembers
+    uint64_t started_at = static_cast<uint64_t>(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+    
+    if (!events_.open()) {
+        logError("Cannot follow zpool events, checking every " + std::to_string(config_.monitor_interval) + " seconds");
+    }
+    runSingleCheck();
+    
+    auto next_check = steady_clock::now() + std::chrono::seconds(
+        events_.isOpen() ? config_.reconcile_interval : config_.monitor_interval);
+    std::set<std::string> pending_pools;
+    bool pending_all = false;
+    steady_clock::time_point first_event, last_event;
+    // Classes and vdevs of the pending events, logged once per burst
+    std::map<std::string, int> burst_classes;
+    std::set<std::string> burst_vdevs;
+    
+    // Disk latency is sampled every monitor_interval as when polling, since
+    // the reconcile is too rare to see a slow disk and the event refreshes
+    // should not wait a second for it
+    bool sample_latency = config_.monitor_zfs_disks && config_.monitor_slow_disks;
+    auto next_latency_sample = steady_clock::now();
+    
+    while (running_) {
+        auto now = steady_clock::now();
+        bool pending = pending_all || !pending_pools.empty();
+        
+        if (pending && (now - last_event >= settle_time || now - first_event >= max_delay)) {
+            std::string summary;
+            for (const auto& [event_class, count] : burst_classes) {
+                summary += (summary.empty() ? "" : ", ") + std::to_string(count) + "x " + event_class;
+            }
+            std::string pools = pending_all ? "all pools" : "";
+            for (const auto& pool : pending_pools) {
+                pools += (pools.empty() ? "" : ", ") + pool;
+            }
+            std::string vdevs;
+            for (const auto& vdev : burst_vdevs) {
+                vdevs += (vdevs.empty() ? "" : ", ") + vdev;
+            }
+            logMessage("ZFS events " + summary + " on " + pools + (vdevs.empty() ? "" : " (" + vdevs + ")"));
+            burst_classes.clear();
+            burst_vdevs.clear();
+            
+            if (pending_all) {
+                runSingleCheck();
+                next_check = now + std::chrono::seconds(config_.reconcile_interval);
+            } else {
+                std::cout << "=== ZFS event update at " << getCurrentTimestamp() << " ===" << std::endl;
+                for (const auto& pool : pending_pools) {
+                    zfs_executor_->refreshPool(snapshot_, pool, config_.zfs_pools);
+                }
+                updateFromSnapshot(false);
+                std::cout << std::endl;
+            }
+            pending_pools.clear();
+            pending_all = false;
+        }
+        
+        // The safety net for missed events, or polling while zpool events is not running
+        if (now >= next_check) {
+            if (!events_.isOpen() && events_.open()) {
+                logMessage("Following zpool events again");
+            }
+            runSingleCheck();
+            next_check = now + std::chrono::seconds(
+                events_.isOpen() ? config_.reconcile_interval : config_.monitor_interval);
+        }
+        
+        // Not while a burst is pending, and the disk LEDs are only updated
+        // when a disk became slow or recovered
+        if (sample_latency && now >= next_latency_sample && !pending_all && pending_pools.empty()) {
+            if (latency_.sample(*zfs_executor_, snapshot_.pools) && latency_.slowChanged()) {
+                std::cout << "=== ZFS disk latency update at " << getCurrentTimestamp() << " ===" << std::endl;
+                monitorZfsDisks();
+                std::cout << std::endl;
+            }
+            next_latency_sample = now + std::chrono::seconds(config_.monitor_interval);
+        }
+        
+        if (!events_.isOpen()) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+        
+        // Wake up in time for the update of a pending burst
+        int timeout_ms = 1000;
+        if (pending_all || !pending_pools.empty()) {
+            auto due = std::min(last_event + settle_time, first_event + max_delay);
+            timeout_ms = static_cast<int>(std::clamp<int64_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(due - steady_clock::now()).count() + 1, 0, 1000));
+        }
+        
+        struct pollfd pfd = {events_.fd(), POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            continue;
+        }
+        
+        std::vector<ZfsEvent> events;
+        bool open = events_.read(events);
+        for (const auto& event : events) {
+            if ((event.time != 0 && event.time < started_at) || !event.changesPoolState()) {
+                continue;
+            }
+            
+            if (!pending_all && pending_pools.empty()) {
+                first_event = steady_clock::now();
+            }
+            burst_classes[event.event_class]++;
+            if (!event.vdev_path.empty()) {
+                burst_vdevs.insert(event.vdev_path);
+            }
+            if (event.pool.empty()) {
+                pending_all = true;
+            } else {
+                pending_pools.insert(event.pool);
+            }
+            last_event = steady_clock::now();
+        }
+        
+        if (!open) {
+            logError("zpool events stopped, checking every " + std::to_string(config_.monitor_interval) + " seconds");
+            next_check = std::min(next_check, steady_clock::now() + std::chrono::seconds(config_.monitor_interval));
+        }
+    }
+    
+    events_.close();
+}
+
 void ZfsMonitor::stopMonitoring() {
     running_ = false;
 }
 
 ZfsPoolHealth ZfsMonitor::checkPoolStatus(const std::string& pool_name) {
-    ZfsPoolInfo info = zfs_executor_->getPoolInfo(pool_name);
-    return info.health;
+    const ZfsPoolInfo* info = snapshot_.valid ? snapshot_.findPool(pool_name) : nullptr;
+    if (info) {
+        return info->health;
+    }
+    return zfs_executor_->getPoolInfo(pool_name).health;
 }
 
 std::map<std::string, std::string> ZfsMonitor::buildGuidToDeviceMap() {
     std::map<std::string, std::string> guid_to_device;
     
-    // Get all block devices that could be ZFS devices
-    std::string find_cmd = "find /dev -name 'sd*' -o -name 'nvme*' 2>/dev/null | grep -E '(sd[a-z]+|nvme[0-9]+n[0-9]+)$'";
-    std::string devices_output = zfs_executor_->executeCommand(find_cmd);
-    
-    std::istringstream devices_stream(devices_output);
-    std::string device;
+    // All disks that could be ZFS devices
+    DIR* dir = opendir("/sys/block");
+    if (!dir) {
+        return guid_to_device;
+    }
     
-    while (std::getline(devices_stream, device)) {
-        device = trimString(device);
-        if (device.empty()) continue;
-        
-        // Method 1: Check if device is part of any ZFS pool by looking for ZFS signatures
-        std::string zfs_check_cmd = "file -s " + device + " 2>/dev/null | grep -i zfs";
-        std::string zfs_signature = zfs_executor_->executeCommand(zfs_check_cmd);
-        
-        if (!zfs_signature.empty()) {
-            // This device has ZFS data, now try to find which pool it belongs to
-            
-            // Method 1a: Use blkid to get filesystem info
-            std::string blkid_cmd = "blkid " + device + " 2>/dev/null";
-            std::string blkid_output = zfs_executor_->executeCommand(blkid_cmd);
-            
-            // Method 1b: Check if device is actively used by any imported pool
-            // by checking /proc/spl/kstat/zfs for device usage
-            std::string kstat_cmd = "cat /proc/spl/kstat/zfs/*/io 2>/dev/null | grep -B1 -A1 '" + 
-                                  device.substr(device.find_last_of('/') + 1) + "' || echo ''";
-            std::string kstat_output = zfs_executor_->executeCommand(kstat_cmd);
-            
-            if (!kstat_output.empty()) {
-                // Device is actively used by ZFS, mark it as part of a pool
-                guid_to_device["ZFS_ACTIVE_" + device.substr(device.find_last_of('/') + 1)] = device;
-            }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string device_name = entry->d_name;
+        if (device_name.rfind("sd", 0) != 0 && device_name.rfind("nvme", 0) != 0) {
+            continue;
         }
         
-        // Method 2: Use the device identifiers we already collect
-        std::vector<std::string> identifiers = getDeviceIdentifiers(device);
-        for (const auto& identifier : identifiers) {
+        std::string device = "/dev/" + device_name;
+        for (const auto& identifier : getDeviceIdentifiers(device)) {
             guid_to_device[identifier] = device;
         }
-        
-        // Method 3: Simple device name mapping
-        std::string device_name = device.substr(device.find_last_of('/') + 1);
-        guid_to_device[device_name] = device;
-        guid_to_device[device] = device;
     }
+    closedir(dir);
     
     return guid_to_device;
 }
@@ -601,97 +1204,22 @@ ZfsDiskStatus ZfsMonitor::checkDiskZfsStatus(const std::string& device_path) {
         return ZfsDiskStatus::DEVICE_NOT_FOUND;
     }
     
-    // Get list of pools and check if any pools exist
-    std::vector<std::string> pools = zfs_executor_->getPoolList();
-    
-    if (pools.empty()) {
-        return ZfsDiskStatus::NOT_IN_POOL;
-    }
-    
-    // Strategy 1: Check if device has ZFS filesystem signature
-    std::string zfs_check_cmd = "file -s " + device_path + " 2>/dev/null | grep -i zfs";
-    std::string zfs_signature = zfs_executor_->executeCommand(zfs_check_cmd);
-    
-    if (!zfs_signature.empty()) {
-        // Device has ZFS signature, check pool health to determine disk status
-        for (const auto& pool : pools) {
-            ZfsPoolInfo pool_info = zfs_executor_->getPoolInfo(pool);
-            
-            // If this pool exists and is healthy, assume disk is part of it and online
-            if (pool_info.health == ZfsPoolHealth::ONLINE) {
-                return ZfsDiskStatus::ONLINE;
-            } else if (pool_info.health == ZfsPoolHealth::DEGRADED) {
-                return ZfsDiskStatus::DEGRADED;
-            } else if (pool_info.health == ZfsPoolHealth::FAULTED) {
-                return ZfsDiskStatus::FAULTED;
-            }
-        }
-        
-        // Has ZFS signature but pools aren't healthy - assume degraded
-        return ZfsDiskStatus::DEGRADED;
-    }
-    
-    // Strategy 2: Check if device is actively being used by examining iostat
-    std::string device_name = device_path.substr(device_path.find_last_of('/') + 1);
-    std::string iostat_cmd = "iostat -x 1 1 2>/dev/null | grep '" + device_name + "' | awk '{print $10}'";
-    std::string util_output = zfs_executor_->executeCommand(iostat_cmd);
-    
-    if (!util_output.empty()) {
-        util_output = trimString(util_output);
-        try {
-            double utilization = std::stod(util_output);
-            if (utilization > 0.1) { // Device has some activity
-                // Check if any pools exist - if so, assume device is part of active pool
-                for (const auto& pool : pools) {
-                    ZfsPoolInfo pool_info = zfs_executor_->getPoolInfo(pool);
-                    if (pool_info.health == ZfsPoolHealth::ONLINE) {
-                        return ZfsDiskStatus::ONLINE;
-                    }
-                }
-            }
-        } catch (const std::exception& e) {
-            // Ignore parsing errors
-        }
-    }
-    
-    // Strategy 3: Fallback - if we have healthy pools but can't identify this device,
-    // use simple heuristic based on device availability and pool count
-    bool has_healthy_pools = false;
-    int pool_count = 0;
-    
-    for (const auto& pool : pools) {
-        ZfsPoolInfo pool_info = zfs_executor_->getPoolInfo(pool);
-        pool_count++;
-        if (pool_info.health == ZfsPoolHealth::ONLINE || pool_info.health == ZfsPoolHealth::DEGRADED) {
-            has_healthy_pools = true;
-        }
+    if (!snapshot_.valid) {
+        snapshot_ = zfs_executor_->takeSnapshot(config_.zfs_pools);
+        dev_disks_.refresh();
+        disk_index_.build(snapshot_.pools, dev_disks_, [this] { return buildGuidToDeviceMap(); });
     }
     
-    // If we have ZFS pools and this is a valid block device, make educated guess
-    if (has_healthy_pools && pool_count > 0) {
-        // Check if device is a standard SATA/NVMe drive that could be in a pool
-        if (device_path.find("/dev/sd") == 0 || device_path.find("/dev/nvme") == 0) {
-            // For this specific case where we know Data pool exists with 4 disks,
-            // assume the first 4 sata devices (sda,sdb,sdc,sdd) are part of the pool
-            std::string last_char = device_path.substr(device_path.length() - 1);
-            if (last_char >= "a" && last_char <= "d" && device_path.find("/dev/sd") == 0) {
-                // This is one of the first 4 SATA devices, likely part of raidz
-                for (const auto& pool : pools) {
-                    ZfsPoolInfo pool_info = zfs_executor_->getPoolInfo(pool);
-                    if (pool_info.health == ZfsPoolHealth::ONLINE) {
-                        return ZfsDiskStatus::ONLINE;
-                    } else if (pool_info.health == ZfsPoolHealth::DEGRADED) {
-                        return ZfsDiskStatus::DEGRADED;
-                    } else if (pool_info.health == ZfsPoolHealth::FAULTED) {
-                        return ZfsDiskStatus::FAULTED;
-                    }
-                }
-            }
-        }
+    // State of the leaf vdev on this disk in the vdev tree of the cycle
+    const ZfsDiskVdev* vdev = disk_index_.find(ZfsDiskIndex::diskOfPath(device_path, dev_disks_));
+    if (!vdev) {
+        return ZfsDiskStatus::NOT_IN_POOL;
     }
-    
-    // Device not identified as part of any pool
-    return ZfsDiskStatus::NOT_IN_POOL;
+    return vdev->status;
+}
+
+const DiskIoRates* ZfsMonitor::getDiskIoRates(const std::string& device_path) const {
+    return disk_stats_.rates(device_path);
 }
 
 ZfsDiskStatus ZfsMonitor::parseZfsStatusFromOutput(const std::string& status_output, const std::string& identifier) {
@@ -732,13 +1260,7 @@ ZfsDiskStatus ZfsMonitor::parseZfsStatusFromOutput(const std::string& status_out
 }
 
 void ZfsMonitor::monitorZfsPools() {
-    std::vector<std::string> pools;
-    
-    if (config_.zfs_pools.empty()) {
-        pools = zfs_executor_->getPoolList();
-    } else {
-        pools = config_.zfs_pools;
-    }
+    const std::vector<ZfsPoolInfo>& pools = snapshot_.pools;
     
     if (pools.empty()) {
         std::cout << "No ZFS pools found to monitor" << std::endl;
@@ -749,8 +1271,8 @@ void ZfsMonitor::monitorZfsPools() {
     ZfsPoolHealth overall_status = ZfsPoolHealth::ONLINE;
     std::vector<std::string> status_messages;
     
-    for (const auto& pool : pools) {
-        ZfsPoolInfo info = zfs_executor_->getPoolInfo(pool);
+    for (const auto& info : pools) {
+        const std::string& pool = info.name;
         
         switch (info.health) {
             case ZfsPoolHealth::ONLINE:
@@ -842,7 +1364,9 @@ void ZfsMonitor::monitorZfsDisks() {
         std::string led_name = led_names_[i];
         
         if (device.empty()) {
-            updateLed(led_name, config_.color_offline, 0);
+            // The error history of a pulled disk is not passed on to the next one
+            disks_[i] = ZfsDiskInfo();
+            showDiskLed(i, ZfsDiskLed::Mode::SOLID, config_.color_offline, 0);
             std::cout << "Disk " << i << " (" << led_name << "): No disk detected" << std::endl;
             continue;
         }
@@ -878,35 +1402,140 @@ void ZfsMonitor::monitorZfsDisks() {
                 break;
         }
         
-        updateLed(led_name, color);
-        std::cout << "Disk " << i << " (" << led_name << "): " << status_desc << " - " << device << std::endl;
+        const ZfsDiskVdev* vdev = disk_index_.find(ZfsDiskIndex::diskOfPath(device, dev_disks_));
+        if (vdev) {
+            status_desc += " " + vdev->pool + " (" + vdev->vdev_path +
+                           (vdev->vdev_class.empty() ? "" : ", " + vdev->vdev_class) + ")";
+        }
+        
+        ZfsDiskInfo& disk = disks_[i];
+        disk.status = status;
+        if (trackDiskErrors(disk, device, vdev)) {
+            logError("Disk " + std::to_string(i) + " (" + device + "): ZFS error counters increased to read " +
+                     std::to_string(disk.read_errors) + ", write " + std::to_string(disk.write_errors) +
+                     ", checksum " + std::to_string(disk.checksum_errors));
+        }
+        
+        const ZfsVdevLatency* latency = vdev ? latency_.find(vdev->vdev_path) : nullptr;
+        
+        // A disk that is still in use but keeps getting errors breathes, one
+        // that is much slower than the rest of its vdev blinks, and a faulted
+        // one stays red
+        if (disk.errors_increased && status != ZfsDiskStatus::FAULTED) {
+            showDiskLed(i, ZfsDiskLed::Mode::BREATHE, config_.color_disk_errors);
+            status_desc += ", errors increased";
+        } else if (latency && latency->slow && status != ZfsDiskStatus::FAULTED) {
+            showDiskLed(i, ZfsDiskLed::Mode::BLINK, config_.color_disk_slow);
+            status_desc += ", slow";
+        } else {
+            showDiskLed(i, ZfsDiskLed::Mode::SOLID, color);
+        }
+        std::cout << "Disk " << i << " (" << led_name << "): " << status_desc << " - " << device;
+        if (disk.errors > 0) {
+            std::cout << ", errors R " << disk.read_errors << " W " << disk.write_errors
+                      << " C " << disk.checksum_errors << " (increased in "
+                      << __builtin_popcount(disk.error_increases) << " of the last 8 checks)";
+        }
+        
+        const DiskIoRates* rates = getDiskIoRates(device);
+        if (rates) {
+            std::ostringstream io;
+            io << std::fixed << std::setprecision(1) << ", " << rates->utilization << "% busy, "
+               << rates->read_bytes_per_sec / 1048576 << " MiB/s read, "
+               << rates->write_bytes_per_sec / 1048576 << " MiB/s write";
+            std::cout << io.str();
+        }
+        if (latency) {
+            std::ostringstream wait;
+            wait << std::fixed << std::setprecision(1) << ", disk wait " << latency->read_ms << " ms read, "
+                 << latency->write_ms << " ms write";
+            if (latency->slow) {
+                wait << " (others " << latency->peers_ms << " ms)";
+            }
+            std::cout << wait.str();
+        }
+        std::cout << std::endl;
     }
 }
 
-void ZfsMonitor::monitorScrubResilver() {
-    if (!config_.monitor_scrub_status) {
+// Set the LED of a disk slot, unless it already shows the same. A failed
+// write is tried again on the next check.
+void ZfsMonitor::showDiskLed(size_t slot, ZfsDiskLed::Mode mode, const LedColor& color, uint8_t brightness) {
+    ZfsDiskLed& led = disk_leds_[slot];
+    if (led.mode == mode && led.color.r == color.r && led.color.g == color.g &&
+        led.color.b == color.b && led.brightness == brightness) {
         return;
     }
     
-    std::vector<std::string> pools;
-    if (config_.zfs_pools.empty()) {
-        pools = zfs_executor_->getPoolList();
+    const std::string& led_name = led_names_[slot];
+    bool set;
+    switch (mode) {
+        case ZfsDiskLed::Mode::BREATHE:
+            set = breatheLed(led_name, color, 500, 500);
+            break;
+        case ZfsDiskLed::Mode::BLINK:
+            set = blinkLed(led_name, color, 250, 750);
+            break;
+        default:
+            set = updateLed(led_name, color, brightness);
+            break;
+    }
+    
+    led.mode = set ? mode : ZfsDiskLed::Mode::UNSET;
+    led.color = color;
+    led.brightness = brightness;
+}
+
+// Compare the error counters of the vdevs on the disk of a slot with the
+// previous check, and return whether they increased
+bool ZfsMonitor::trackDiskErrors(ZfsDiskInfo& disk, const std::string& device, const ZfsDiskVdev* vdev) {
+    uint64_t read_errors = vdev ? vdev->read_errors : 0;
+    uint64_t write_errors = vdev ? vdev->write_errors : 0;
+    uint64_t checksum_errors = vdev ? vdev->checksum_errors : 0;
+    std::string pool_name = vdev ? vdev->pool : "";
+    bool increased = false;
+    
+    if (disk.device_path != device || disk.pool_name != pool_name) {
+        // Another disk or pool in this slot, start over
+        disk.device_path = device;
+        disk.device_name = device.substr(device.find_last_of('/') + 1);
+        disk.pool_name = pool_name;
+        disk.error_increases = 0;
+        disk.errors_increased = false;
+    } else if (read_errors < disk.read_errors || write_errors < disk.write_errors ||
+               checksum_errors < disk.checksum_errors) {
+        // `zpool clear` resets the counters
+        disk.errors_increased = false;
     } else {
-        pools = config_.zfs_pools;
+        increased = read_errors > disk.read_errors || write_errors > disk.write_errors ||
+                    checksum_errors > disk.checksum_errors;
     }
     
-    bool scrub_active = false;
-    bool resilver_active = false;
-    bool scrub_errors = false;
+    disk.error_increases = static_cast<uint8_t>((disk.error_increases << 1) | (increased ? 1 : 0));
+    disk.errors_increased = disk.errors_increased || increased;
+    disk.read_errors = read_errors;
+    disk.write_errors = write_errors;
+    disk.checksum_errors = checksum_errors;
+    disk.errors = read_errors + write_errors + checksum_errors;
+    return increased;
+}
+
+void ZfsMonitor::monitorScrubResilver() {
+    if (!config_.monitor_scrub_status) {
+        return;
+    }
     
-    for (const auto& pool : pools) {
-        ZfsPoolInfo info = zfs_executor_->getPoolInfo(pool);
-        
-        if (info.scrub_active) {
-            scrub_active = true;
-        }
-        if (info.resilver_active) {
-            resilver_active = true;
+    bool scrub_errors = false;
+    const ZfsPoolInfo* scanning = nullptr;
+    
+    // Show the scan that is furthest from done, resilvers first
+    for (const auto& info : snapshot_.pools) {
+        if (info.scrub_active || info.resilver_active) {
+            if (!scanning || (info.resilver_active && !scanning->resilver_active) ||
+                (info.resilver_active == scanning->resilver_active &&
+                 info.scan.percent_done < scanning->scan.percent_done)) {
+                scanning = &info;
+            }
         }
         if (info.scrub_errors) {
             scrub_errors = true;
@@ -914,14 +1543,36 @@ void ZfsMonitor::monitorScrubResilver() {
     }
     
     LedColor color;
+    uint8_t brightness = 128;
     std::string status_desc;
     
-    if (resilver_active) {
-        color = config_.color_resilver;
-        status_desc = "Resilver in progress";
-    } else if (scrub_active) {
-        color = config_.color_scrub_active;
-        status_desc = "Scrub in progress";
+    if (scanning) {
+        const ZfsScanInfo& scan = scanning->scan;
+        color = scanning->resilver_active ? config_.color_resilver : config_.color_scrub_active;
+        status_desc = std::string(scanning->resilver_active ? "Resilver" : "Scrub") +
+                      " in progress on " + scanning->name;
+        
+        // The brightness ramps up with the progress in 8 steps, from 64 to 248
+        double done = std::min(std::max(scan.percent_done, 0.0), 100.0);
+        brightness = static_cast<uint8_t>(64 + static_cast<int>(done / 12.5) * 23);
+        
+        std::ostringstream progress;
+        progress << std::fixed << std::setprecision(1);
+        if (scan.percent_done >= 0) {
+            progress << ", " << scan.percent_done << "% done";
+        }
+        if (scan.bytes_total > 0) {
+            progress << ", " << (scan.bytes_issued ? scan.bytes_issued : scan.bytes_scanned) / 1073741824.0
+                     << " of " << scan.bytes_total / 1073741824.0 << " GiB";
+        }
+        if (scan.rate > 0) {
+            progress << " at " << scan.rate / 1048576.0 << " MiB/s";
+        }
+        if (scan.eta_seconds >= 0) {
+            progress << ", " << scan.eta_seconds / 3600 << "h" << std::setw(2) << std::setfill('0')
+                     << scan.eta_seconds / 60 % 60 << "m to go";
+        }
+        status_desc += progress.str();
     } else if (scrub_errors) {
         color = config_.color_scrub_progress;
         status_desc = "Recent scrub found and repaired errors";
@@ -930,10 +1581,48 @@ void ZfsMonitor::monitorScrubResilver() {
         status_desc = "All pools healthy";
     }
     
-    updateLed(config_.network_led, color, scrub_active || resilver_active ? 255 : 128);
+    // Each write is a few I2C transfers, so the LED is only written when it
+    // changes, and the progress at most every 20 seconds
+    auto now = std::chrono::steady_clock::now();
+    bool same_color = scan_led_set_ && scan_led_color_.r == color.r &&
+                      scan_led_color_.g == color.g && scan_led_color_.b == color.b;
+    if (!same_color) {
+        scan_led_set_ = updateLed(config_.network_led, color, brightness);
+        scan_led_color_ = color;
+        scan_led_brightness_ = brightness;
+        scan_led_updated_ = now;
+    } else if (brightness != scan_led_brightness_ && now - scan_led_updated_ >= std::chrono::seconds(20)) {
+        scan_led_set_ = setLedBrightness(config_.network_led, brightness);
+        scan_led_brightness_ = brightness;
+        scan_led_updated_ = now;
+    }
+    
     std::cout << "Scrub/Resilver Status: " << status_desc << std::endl;
 }
 
+// Map LED names to types
+static bool ledType(const std::string& led_name, ugreen_leds_t::led_type_t& led_type) {
+    static const std::pair<const char*, ugreen_leds_t::led_type_t> types[] = {
+        {"power", ugreen_leds_t::led_type_t::power},
+        {"netdev", ugreen_leds_t::led_type_t::netdev},
+        {"disk1", ugreen_leds_t::led_type_t::disk1},
+        {"disk2", ugreen_leds_t::led_type_t::disk2},
+        {"disk3", ugreen_leds_t::led_type_t::disk3},
+        {"disk4", ugreen_leds_t::led_type_t::disk4},
+        {"disk5", ugreen_leds_t::led_type_t::disk5},
+        {"disk6", ugreen_leds_t::led_type_t::disk6},
+        {"disk7", ugreen_leds_t::led_type_t::disk7},
+        {"disk8", ugreen_leds_t::led_type_t::disk8}
+    };
+    for (const auto& type : types) {
+        if (led_name == type.first) {
+            led_type = type.second;
+            return true;
+        }
+    }
+    return false;
+}
+
 bool ZfsMonitor::updateLed(const std::string& led_name, const LedColor& color, uint8_t brightness) {
     if (!led_available_ || !led_controller_) {
         return false;
@@ -941,29 +1630,7 @@ bool ZfsMonitor::updateLed(const std::string& led_name, const LedColor& color, u
     
     try {
         ugreen_leds_t::led_type_t led_type = ugreen_leds_t::led_type_t::power; // Default
-        
-        // Map LED names to types (simplified mapping)
-        if (led_name == "power") {
-            led_type = ugreen_leds_t::led_type_t::power;
-        } else if (led_name == "netdev") {
-            led_type = ugreen_leds_t::led_type_t::netdev;
-        } else if (led_name == "disk1") {
-            led_type = ugreen_leds_t::led_type_t::disk1;
-        } else if (led_name == "disk2") {
-            led_type = ugreen_leds_t::led_type_t::disk2;
-        } else if (led_name == "disk3") {
-            led_type = ugreen_leds_t::led_type_t::disk3;
-        } else if (led_name == "disk4") {
-            led_type = ugreen_leds_t::led_type_t::disk4;
-        } else if (led_name == "disk5") {
-            led_type = ugreen_leds_t::led_type_t::disk5;
-        } else if (led_name == "disk6") {
-            led_type = ugreen_leds_t::led_type_t::disk6;
-        } else if (led_name == "disk7") {
-            led_type = ugreen_leds_t::led_type_t::disk7;
-        } else if (led_name == "disk8") {
-            led_type = ugreen_leds_t::led_type_t::disk8;
-        }
+        ledType(led_name, led_type);
         
         int result = led_controller_->set_rgb(led_type, color.r, color.g, color.b);
         if (result == 0) {
@@ -978,6 +1645,68 @@ bool ZfsMonitor::updateLed(const std::string& led_name, const LedColor& color, u
     }
 }
 
+bool ZfsMonitor::breatheLed(const std::string& led_name, const LedColor& color, uint16_t t_on, uint16_t t_off) {
+    if (!led_available_ || !led_controller_) {
+        return false;
+    }
+    
+    ugreen_leds_t::led_type_t led_type;
+    if (!ledType(led_name, led_type)) {
+        return false;
+    }
+    
+    try {
+        int result = led_controller_->set_rgb(led_type, color.r, color.g, color.b);
+        if (result == 0) {
+            result = led_controller_->set_breath(led_type, t_on, t_off);
+        }
+        return (result == 0);
+    } catch (const std::exception& e) {
+        std::cerr << "Error updating LED " << led_name << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool ZfsMonitor::blinkLed(const std::string& led_name, const LedColor& color, uint16_t t_on, uint16_t t_off) {
+    if (!led_available_ || !led_controller_) {
+        return false;
+    }
+    
+    ugreen_leds_t::led_type_t led_type;
+    if (!ledType(led_name, led_type)) {
+        return false;
+    }
+    
+    try {
+        int result = led_controller_->set_rgb(led_type, color.r, color.g, color.b);
+        if (result == 0) {
+            result = led_controller_->set_blink(led_type, t_on, t_off);
+        }
+        return (result == 0);
+    } catch (const std::exception& e) {
+        std::cerr << "Error updating LED " << led_name << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool ZfsMonitor::setLedBrightness(const std::string& led_name, uint8_t brightness) {
+    if (!led_available_ || !led_controller_) {
+        return false;
+    }
+    
+    ugreen_leds_t::led_type_t led_type;
+    if (!ledType(led_name, led_type)) {
+        return false;
+    }
+    
+    try {
+        return led_controller_->set_brightness(led_type, brightness) == 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error updating LED " << led_name << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
 bool ZfsMonitor::turnOffAllLeds() {
     if (!led_available_ || !led_controller_) {
         return false;
@@ -1000,6 +1729,7 @@ bool ZfsMonitor::turnOffAllLeds() {
     for (auto led : all_leds) {
         led_controller_->set_onoff(led, 0);
     }
+    disk_leds_.assign(led_names_.size(), ZfsDiskLed());
     
     return true;
 }
@@ -1038,6 +1768,7 @@ void ZfsMonitor::showStatus() const {
     std::cout << "Pool Monitoring: " << (config_.monitor_zfs_pools ? "Enabled" : "Disabled") << std::endl;
     std::cout << "Disk Monitoring: " << (config_.monitor_zfs_disks ? "Enabled" : "Disabled") << std::endl;
     std::cout << "Scrub Monitoring: " << (config_.monitor_scrub_status ? "Enabled" : "Disabled") << std::endl;
+    std::cout << "Slow Disk Detection: " << (config_.monitor_slow_disks ? "Enabled" : "Disabled") << std::endl;
 }
 
 // Utility function implementations
@@ -4,8 +4,12 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <memory>
 #include <chrono>
+#include <string_view>
+#include <functional>
+#include <sys/types.h>
 
 // ZFS Pool Health Status
 enum class ZfsPoolHealth {
@@ -35,6 +39,40 @@ struct LedColor {
     LedColor(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0) : r(red), g(green), b(blue) {}
 };
 
+// A vdev of the tree printed by `zpool status`
+struct ZfsVdev {
+    std::string name;           // e.g. raidz1-0, mirror-1, or a device path with -P
+    std::string state;          // ONLINE, DEGRADED, FAULTED, UNAVAIL, REMOVED, AVAIL, ...
+    uint64_t read_errors = 0;
+    uint64_t write_errors = 0;
+    uint64_t checksum_errors = 0;
+    std::string note;           // trailing text, e.g. "was /dev/sdc1" or "(resilvering)"
+    std::string vdev_class;     // empty for data vdevs, or special, logs, cache, spares, dedup
+    std::vector<ZfsVdev> children;
+    
+    bool isLeaf() const { return children.empty(); }
+};
+
+// Scrub / resilver state from the scan line of `zpool status`
+struct ZfsScanInfo {
+    enum class Type { NONE, SCRUB, RESILVER };
+    
+    Type type = Type::NONE;
+    bool in_progress = false;
+    bool canceled = false;
+    double percent_done = -1;   // -1 when not reported
+    std::string repaired;       // amount repaired or resilvered, e.g. 0B, or 0 with -p
+    uint64_t repaired_bytes = 0;
+    uint64_t errors = 0;
+    
+    // Progress of a scan in progress, in bytes
+    uint64_t bytes_scanned = 0;
+    uint64_t bytes_issued = 0;
+    uint64_t bytes_total = 0;
+    uint64_t rate = 0;          // bytes per second issued, or scanned by old versions
+    int64_t eta_seconds = -1;   // -1 when not reported
+};
+
 // ZFS Pool Information
 struct ZfsPoolInfo {
     std::string name;
@@ -44,15 +82,259 @@ struct ZfsPoolInfo {
     bool resilver_active;
     bool scrub_errors;
     uint64_t errors;
+    
+    // Filled by parseZpoolStatus()
+    std::string state;
+    ZfsScanInfo scan;
+    std::vector<ZfsVdev> vdevs;
+};
+
+// Parse the output of `zpool status [-P] [-L] [-p]` for any number of pools in
+// a single pass, into pools with their vdev trees and scan state
+std::vector<ZfsPoolInfo> parseZpoolStatus(std::string_view output);
+
+// State of all pools, taken once per monitoring cycle and shared by all checks
+struct ZfsSnapshot {
+    bool valid = false;
+    std::chrono::system_clock::time_point taken_at;
+    std::vector<ZfsPoolInfo> pools;
+
+    const ZfsPoolInfo* findPool(const std::string& pool_name) const;
+};
+
+// The leaf vdev found on a physical disk
+struct ZfsDiskVdev {
+    std::string pool;
+    std::string vdev_path;      // name of the leaf vdev in `zpool status`
+    std::string vdev_class;
+    std::string state;
+    ZfsDiskStatus status = ZfsDiskStatus::UNKNOWN;
+    
+    // Summed over all the vdevs on the disk
+    uint64_t read_errors = 0;
+    uint64_t write_errors = 0;
+    uint64_t checksum_errors = 0;
+};
+
+// The links of /dev/disk/by-* by the device they point to, read with one
+// readdir + readlinkat pass and read again only when udev changed them
+class DevDiskIndex {
+public:
+    // Read the links again if any of the /dev/disk directories changed
+    void refresh();
+    
+    // Device a link points to (e.g. /dev/sda1), from the path or the bare name
+    // of the link, empty if there is no such link
+    std::string resolve(const std::string& link) const;
+    // Paths of the links pointing to a device
+    const std::vector<std::string>& aliases(const std::string& device) const;
+    
+private:
+    std::unordered_map<std::string, std::string> targets_;
+    std::unordered_map<std::string, std::vector<std::string>> aliases_;
+    std::vector<std::pair<std::string, int64_t>> dir_mtimes_;
+    
+    std::vector<std::pair<std::string, int64_t>> directoryTimes() const;
+};
+
+// Index of the leaf vdevs of all pools by the kernel name of the disk they
+// are on (sda, nvme0n1), resolved in process from by-id, by-partuuid, wwn,
+// by-vdev or plain partition paths
+class ZfsDiskIndex {
+public:
+    // Resolves the vdevs listed by guid, see ZfsMonitor::buildGuidToDeviceMap().
+    // It reads the labels of all disks, so it is only called when a leaf
+    // cannot be found by its path.
+    using GuidMapBuilder = std::function<std::map<std::string, std::string>()>;
+    
+    void build(const std::vector<ZfsPoolInfo>& pools, const DevDiskIndex& dev_disks,
+               const GuidMapBuilder& build_guid_map);
+    
+    // disk is a kernel name or a /dev path of a whole disk
+    const ZfsDiskVdev* find(const std::string& disk) const;
+    bool empty() const { return by_disk_.empty(); }
+    
+    // Kernel name of the disk holding a vdev path, empty if it does not exist
+    static std::string diskOfPath(const std::string& path, const DevDiskIndex& dev_disks);
+    static ZfsDiskStatus statusOfState(const std::string& state);
+    
+private:
+    std::unordered_map<std::string, ZfsDiskVdev> by_disk_;
+    
+    // Built on the first leaf not found by its path
+    const GuidMapBuilder* build_guid_map_ = nullptr;
+    std::unique_ptr<std::map<std::string, std::string>> guid_to_device_;
+    
+    void addLeaves(const std::string& pool, const std::vector<ZfsVdev>& vdevs, const DevDiskIndex& dev_disks,
+                   std::vector<std::pair<std::string, ZfsDiskVdev>>& missing);
+    std::string diskOfGuid(const std::string& guid, const DevDiskIndex& dev_disks);
+    void add(const std::string& disk, const ZfsDiskVdev& vdev);
+};
+
+// The pool and vdev a device belongs to, from its ZFS vdev label
+struct ZfsVdevLabel {
+    bool valid = false;
+    std::string pool_name;      // empty for spares and cache devices
+    uint64_t pool_guid = 0;
+    uint64_t vdev_guid = 0;
+    uint64_t txg = 0;
+    uint64_t pool_state = 0;    // 0 active, 1 exported, 2 destroyed, 3 spare, 4 cache
+};
+
+// Reads the four vdev labels of a device in process and decodes the XDR
+// nvlist of the newest one, cached until the device is replaced or resized
+class ZfsLabelReader {
+public:
+    const ZfsVdevLabel& read(const std::string& device);
+    
+    // Label of an open device or image file of the given size
+    static ZfsVdevLabel readLabel(int fd, uint64_t size);
+    // Decode the nvlist of one label (the 112K vdev_phys_t)
+    static bool decodeLabel(const uint8_t* data, size_t size, ZfsVdevLabel& label);
+    
+private:
+    struct CachedLabel {
+        std::string change_key;     // device number, size and disk sequence number
+        ZfsVdevLabel label;
+    };
+    
+    std::unordered_map<std::string, CachedLabel> cache_;
+};
+
+// An event of `zpool events -v`
+struct ZfsEvent {
+    std::string event_class;    // e.g. resource.fs.zfs.statechange
+    std::string pool;
+    std::string vdev_path;
+    uint64_t time = 0;          // seconds since the epoch
+    
+    // Whether the event may change the state of its pool or of its vdevs
+    bool changesPoolState() const;
+};
+
+// A long-lived `zpool events -f -H -v`, parsed incrementally as its output arrives
+class ZfsEventStream {
+public:
+    ~ZfsEventStream();
+    
+    bool open();
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    
+    // Read the available output and append the completed events, false once
+    // the stream ended
+    bool read(std::vector<ZfsEvent>& events);
+    void feed(std::string_view data, std::vector<ZfsEvent>& events);
+    
+private:
+    pid_t pid_ = -1;
+    int fd_ = -1;
+    std::string partial_;       // start of a line that is not complete yet
+    ZfsEvent current_;
+    bool in_event_ = false;
+    
+    void parseLine(std::string_view line, std::vector<ZfsEvent>& events);
+    void finishEvent(std::vector<ZfsEvent>& events);
+};
+
+// I/O rates of a block device between two samples of /proc/diskstats
+struct DiskIoRates {
+    double utilization = 0;             // percent of the time with I/O in flight
+    double reads_per_sec = 0;
+    double writes_per_sec = 0;
+    double read_bytes_per_sec = 0;
+    double write_bytes_per_sec = 0;
+    double await_ms = 0;                // average time per completed I/O
+};
+
+// Keeps the previous /proc/diskstats in memory and derives the rates of
+// every block device from the counters of the next sample, without sleeping
+class DiskStatsSampler {
+public:
+    // Read /proc/diskstats, rates are available from the second sample on
+    bool sample();
+    
+    // disk is a kernel name or a /dev path
+    const DiskIoRates* rates(const std::string& disk) const;
+    
+private:
+    struct Counters {
+        uint64_t reads = 0;
+        uint64_t read_sectors = 0;
+        uint64_t read_ms = 0;
+        uint64_t writes = 0;
+        uint64_t write_sectors = 0;
+        uint64_t write_ms = 0;
+        uint64_t io_ms = 0;
+    };
+    
+    std::unordered_map<std::string, Counters> previous_;
+    std::unordered_map<std::string, DiskIoRates> rates_;
+    std::chrono::steady_clock::time_point previous_at_;
+};
+
+class ZfsCommandExecutor;
+
+// Wait times of a leaf vdev, averaged over the cycles
+struct ZfsVdevLatency {
+    double read_ms = 0;         // disk_wait of `zpool iostat -l`
+    double write_ms = 0;
+    int samples = 0;            // cycles with I/O to the vdev
+    bool slow = false;          // well above the other leaves of its parent
+    double peers_ms = 0;        // median wait of the other leaves, when slow
+};
+
+// Runs `zpool iostat -v -l` once per cycle and keeps moving averages of the
+// wait times of every leaf vdev, to find a disk that gets slow before ZFS
+// faults it
+class ZfsLatencySampler {
+public:
+    // Sample the pools for the given seconds, blocking meanwhile
+    bool sample(ZfsCommandExecutor& executor, const std::vector<ZfsPoolInfo>& pools, int seconds = 1);
+    // Add a report of `zpool iostat -v -l -H -p -P -L`, pools give the vdev tree
+    void update(std::string_view iostat_output, const std::vector<ZfsPoolInfo>& pools);
+    
+    // nullptr until the vdev had I/O
+    const ZfsVdevLatency* find(const std::string& vdev_path) const;
+    // Whether a leaf became slow or stopped being slow in the last update
+    bool slowChanged() const { return slow_changed_; }
+    
+private:
+    static void collectLeaves(const std::vector<ZfsVdev>& vdevs,
+                              std::unordered_map<std::string, ZfsVdevLatency>& leaves,
+                              std::vector<const std::vector<ZfsVdev>*>& groups);
+    
+    std::unordered_map<std::string, ZfsVdevLatency> leaves_;
+    bool slow_changed_ = false;
 };
 
 // ZFS Disk Information
 struct ZfsDiskInfo {
     std::string device_path;
     std::string device_name;
-    ZfsDiskStatus status;
+    ZfsDiskStatus status = ZfsDiskStatus::UNKNOWN;
     std::string pool_name;
-    uint64_t errors;
+    uint64_t errors = 0;
+    
+    // READ/WRITE/CKSUM counters of the previous check, the checks in which they
+    // increased (bit 0 is the latest) and whether an increase was not cleared
+    // with `zpool clear` yet
+    uint64_t read_errors = 0;
+    uint64_t write_errors = 0;
+    uint64_t checksum_errors = 0;
+    uint8_t error_increases = 0;
+    bool errors_increased = false;
+};
+
+// What the LED of a disk slot was last set to. It is only written again when
+// this changes, so a breathing or blinking LED keeps its phase.
+struct ZfsDiskLed {
+    enum class Mode { UNSET, SOLID, BREATHE, BLINK };
+    
+    Mode mode = Mode::UNSET;
+    LedColor color;
+    uint8_t brightness = 0;
 };
 
 // Configuration Structure
@@ -62,6 +344,7 @@ struct ZfsMonitorConfig {
     bool monitor_zfs_pools;
     bool monitor_zfs_disks;
     bool monitor_scrub_status;
+    bool monitor_slow_disks;
     bool turn_off_leds_on_exit;
     
     std::vector<std::string> zfs_pools;
@@ -71,6 +354,11 @@ struct ZfsMonitorConfig {
     std::string mapping_method;
     std::vector<std::string> serial_map;
     
+    // Follow `zpool events -f` instead of polling every monitor_interval,
+    // with a full check every reconcile_interval seconds as a safety net
+    bool event_mode;
+    int reconcile_interval;
+    
     // LED Colors
     LedColor color_online;
     LedColor color_degraded;
@@ -80,6 +368,8 @@ struct ZfsMonitorConfig {
     LedColor color_resilver;
     LedColor color_scrub_progress;
     LedColor color_offline;
+    LedColor color_disk_errors;         // breathing, on disks whose error counters increased
+    LedColor color_disk_slow;           // blinking, on disks much slower than the rest of their vdev
     
     // Default constructor with sensible defaults
     ZfsMonitorConfig();
@@ -97,8 +387,17 @@ public:
     ZfsPoolInfo getPoolInfo(const std::string& pool_name);
     std::string getPoolStatus(const std::string& pool_name);
     
+    // State of all pools (or of the given ones) with one `zpool list` and one `zpool status`
+    ZfsSnapshot takeSnapshot(const std::vector<std::string>& pool_filter = {});
+    // Update one pool of a snapshot, adding or removing it if it was imported or exported
+    void refreshPool(ZfsSnapshot& snapshot, const std::string& pool_name,
+                     const std::vector<std::string>& pool_filter = {});
+    
 private:
     bool isZfsAvailable();
+    static ZfsPoolHealth parseHealth(const std::string& health);
+    static void applyStatusOutput(ZfsPoolInfo& info, const std::string& status_output);
+    static void applyParsedStatus(ZfsPoolInfo& info, const ZfsPoolInfo& parsed);
     std::string runCommand(const std::string& command);
 };
 
@@ -129,6 +428,8 @@ private:
     void initializeDefaultMappings();
     void applyModelSpecificMappings();
     std::string runCommand(const std::string& command);
+    // First sd* disk in /sys/block accepted by matches
+    std::string findSataDisk(const std::function<bool(const std::string&)>& matches);
 };
 
 // Forward declaration
@@ -156,9 +457,14 @@ public:
     // Status checking
     ZfsPoolHealth checkPoolStatus(const std::string& pool_name);
     ZfsDiskStatus checkDiskZfsStatus(const std::string& device_path);
+    // I/O rates of a disk since the previous cycle, nullptr before the second cycle
+    const DiskIoRates* getDiskIoRates(const std::string& device_path) const;
     
     // LED control
     bool updateLed(const std::string& led_name, const LedColor& color, uint8_t brightness = 255);
+    bool breatheLed(const std::string& led_name, const LedColor& color, uint16_t t_on, uint16_t t_off);
+    bool blinkLed(const std::string& led_name, const LedColor& color, uint16_t t_on, uint16_t t_off);
+    bool setLedBrightness(const std::string& led_name, uint8_t brightness);
     bool turnOffAllLeds();
     
     // Utilities
@@ -175,6 +481,29 @@ private:
     bool led_available_;
     
     std::vector<std::string> led_names_;
+    std::vector<ZfsDiskInfo> disks_;    // error counter history of each disk slot
+    std::vector<ZfsDiskLed> disk_leds_;
+    
+    // Taken at the start of each cycle, and read by all the checks of the cycle
+    ZfsSnapshot snapshot_;
+    DevDiskIndex dev_disks_;
+    ZfsLabelReader labels_;
+    ZfsDiskIndex disk_index_;
+    DiskStatsSampler disk_stats_;
+    ZfsLatencySampler latency_;
+    
+    // Event mode
+    ZfsEventStream events_;
+    
+    // What the scrub/resilver LED shows, so that it is only written on changes
+    LedColor scan_led_color_;
+    uint8_t scan_led_brightness_ = 0;
+    bool scan_led_set_ = false;
+    std::chrono::steady_clock::time_point scan_led_updated_;
+    
+    // Event refreshes leave out the latency sample, which blocks for a second
+    void updateFromSnapshot(bool sample_latency = true);
+    void monitorEvents();
     
     // Monitoring functions
     void monitorZfsPools();
@@ -182,6 +511,8 @@ private:
     void monitorScrubResilver();
     
     // Utility functions
+    void showDiskLed(size_t slot, ZfsDiskLed::Mode mode, const LedColor& color, uint8_t brightness = 255);
+    bool trackDiskErrors(ZfsDiskInfo& disk, const std::string& device, const ZfsDiskVdev* vdev);
     bool initializeLedController();
     bool loadI2cModules();
     std::vector<std::string> getDeviceIdentifiers(const std::string& device_path);
@@ -0,0 +1,403 @@
+#include "zfs_monitor.h"
+#include <cstdlib>
+
+// Single pass parser of `zpool status`. Every line is looked at once and the
+// vdev tree is built with a stack of the open vdevs, so the whole output of
+// all pools is parsed in linear time without copying it.
+
+namespace {
+
+bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+std::string_view trimView(std::string_view text) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) {
+        return std::string_view();
+    }
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(start, end - start + 1);
+}
+
+// Return the next space separated token of text and drop it from text
+std::string_view nextToken(std::string_view& text) {
+    size_t start = text.find_first_not_of(' ');
+    if (start == std::string_view::npos) {
+        text = std::string_view();
+        return text;
+    }
+    size_t end = text.find(' ', start);
+    if (end == std::string_view::npos) {
+        end = text.size();
+    }
+    std::string_view token = text.substr(start, end - start);
+    text.remove_prefix(end);
+    return token;
+}
+
+// Error counters are exact with -p, otherwise they may be shortened like 1.2K
+bool parseCounter(std::string_view token, uint64_t& value) {
+    if (token.empty() || token[0] < '0' || token[0] > '9') {
+        return false;
+    }
+
+    double number = 0;
+    double scale = 0;
+    size_t i = 0;
+    for (; i < token.size(); i++) {
+        char c = token[i];
+        if (c >= '0' && c <= '9') {
+            if (scale == 0) {
+                number = number * 10 + (c - '0');
+            } else {
+                scale /= 10;
+                number += (c - '0') * scale;
+            }
+        } else if (c == '.' && scale == 0) {
+            scale = 1;
+        } else {
+            break;
+        }
+    }
+
+    if (i < token.size()) {
+        static const std::string_view suffixes = "KMGTPE";
+        size_t power = suffixes.find(token[i]);
+        if (power == std::string_view::npos || i + 1 != token.size()) {
+            return false;
+        }
+        for (size_t p = 0; p <= power; p++) {
+            number *= 1024;
+        }
+    }
+
+    value = static_cast<uint64_t>(number);
+    return true;
+}
+
+// Sizes like 1.23T, 512M/s or 0B, exact with -p on newer versions
+bool parseSize(std::string_view token, uint64_t& value) {
+    if (!token.empty() && token.back() == ',') {
+        token.remove_suffix(1);
+    }
+    if (token.size() > 2 && token.substr(token.size() - 2) == "/s") {
+        token.remove_suffix(2);
+    }
+    if (!token.empty() && token.back() == 'B') {
+        token.remove_suffix(1);
+    }
+    return parseCounter(token, value);
+}
+
+// "HH:MM:SS" of "[N days] HH:MM:SS to go"
+bool parseDuration(std::string_view token, int64_t& seconds) {
+    int64_t total = 0;
+    int64_t part = 0;
+    bool digits = false;
+    for (char c : token) {
+        if (c >= '0' && c <= '9') {
+            part = part * 10 + (c - '0');
+            digits = true;
+        } else if (c == ':' && digits) {
+            total = total * 60 + part;
+            part = 0;
+            digits = false;
+        } else {
+            return false;
+        }
+    }
+    if (!digits) {
+        return false;
+    }
+    seconds = total * 60 + part;
+    return true;
+}
+
+// The progress lines of a scan in progress, of OpenZFS 2.x:
+//   1.23T / 4.56T scanned at 512M/s, 1.00T / 4.56T issued at 400M/s
+//   0B repaired, 21.93% done, 02:30:12 to go
+// of 0.8:
+//   1.23T scanned at 512M/s, 1.00T issued at 400M/s, 4.56T total
+// and of 0.7:
+//   1.23T scanned out of 4.56T at 512M/s, 1h52m to go
+void parseScanProgress(std::string_view status, ZfsScanInfo& scan) {
+    std::vector<std::string_view> words;
+    while (!status.empty()) {
+        std::string_view word = nextToken(status);
+        if (!word.empty()) {
+            words.push_back(word);
+        }
+    }
+    
+    uint64_t scan_rate = 0;
+    for (size_t i = 1; i < words.size(); i++) {
+        std::string_view word = words[i];
+        if (!word.empty() && word.back() == ',') {
+            word.remove_suffix(1);
+        }
+        
+        if (word == "scanned" || word == "issued") {
+            uint64_t& amount = (word == "scanned") ? scan.bytes_scanned : scan.bytes_issued;
+            if (i >= 3 && words[i - 2] == "/") {
+                parseSize(words[i - 3], amount);
+                parseSize(words[i - 1], scan.bytes_total);
+            } else {
+                parseSize(words[i - 1], amount);
+            }
+            size_t at = i + 1;
+            if (at + 2 < words.size() && words[at] == "out" && words[at + 1] == "of") {
+                parseSize(words[at + 2], scan.bytes_total);
+                at += 3;
+            }
+            if (at + 1 < words.size() && words[at] == "at") {
+                parseSize(words[at + 1], word == "scanned" ? scan_rate : scan.rate);
+            }
+        } else if (word == "total") {
+            parseSize(words[i - 1], scan.bytes_total);
+        } else if (word == "to" && i + 1 < words.size() && startsWith(words[i + 1], "go")) {
+            int64_t seconds;
+            if (parseDuration(words[i - 1], seconds)) {
+                uint64_t days = 0;
+                if (i >= 3 && startsWith(words[i - 2], "day")) {
+                    parseCounter(words[i - 3], days);
+                }
+                scan.eta_seconds = seconds + static_cast<int64_t>(days) * 86400;
+            }
+        }
+    }
+    
+    // Before 0.8 scans only report what was scanned
+    if (scan.rate == 0) {
+        scan.rate = scan_rate;
+    }
+}
+
+bool isVdevClass(std::string_view name) {
+    return name == "logs" || name == "cache" || name == "spares" ||
+           name == "special" || name == "dedup";
+}
+
+// Fill a vdev from "<name> <state> <read> <write> <cksum> [note]"
+void parseVdevLine(std::string_view line, ZfsVdev& vdev) {
+    vdev.name = std::string(nextToken(line));
+
+    std::string_view rest = line;
+    std::string_view state = nextToken(rest);
+    if (!state.empty() && state[0] >= 'A' && state[0] <= 'Z') {
+        vdev.state = std::string(state);
+        line = rest;
+    }
+
+    uint64_t* counters[] = {&vdev.read_errors, &vdev.write_errors, &vdev.checksum_errors};
+    for (uint64_t* counter : counters) {
+        rest = line;
+        if (!parseCounter(nextToken(rest), *counter)) {
+            break;
+        }
+        line = rest;
+    }
+
+    vdev.note = std::string(trimView(line));
+}
+
+// Parse the text of the scan key, which may span several lines
+void parseScan(std::string_view text, ZfsPoolInfo& pool) {
+    ZfsScanInfo& scan = pool.scan;
+
+    // Keep the scan text on one line for logging
+    pool.scan_status.clear();
+    std::string_view words = text;
+    for (;;) {
+        size_t start = words.find_first_not_of(" \t\r\n");
+        if (start == std::string_view::npos) {
+            break;
+        }
+        size_t end = words.find_first_of(" \t\r\n", start);
+        if (end == std::string_view::npos) {
+            end = words.size();
+        }
+        if (!pool.scan_status.empty()) {
+            pool.scan_status += ' ';
+        }
+        pool.scan_status.append(words.substr(start, end - start));
+        words.remove_prefix(end);
+    }
+
+    std::string_view status = pool.scan_status;
+    if (startsWith(status, "scrub")) {
+        scan.type = ZfsScanInfo::Type::SCRUB;
+    } else if (startsWith(status, "resilver")) {
+        scan.type = ZfsScanInfo::Type::RESILVER;
+    } else {
+        return;
+    }
+
+    scan.in_progress = status.find("in progress") != std::string_view::npos;
+    scan.canceled = status.find("canceled") != std::string_view::npos;
+    if (scan.in_progress) {
+        parseScanProgress(status, scan);
+    }
+
+    size_t done = status.find("% done");
+    if (done != std::string_view::npos) {
+        size_t start = status.rfind(' ', done);
+        start = (start == std::string_view::npos) ? 0 : start + 1;
+        scan.percent_done = std::atof(std::string(status.substr(start, done - start)).c_str());
+    }
+
+    // "scrub repaired 0B in ..." and "resilvered 1G in ..." once finished,
+    // "0B repaired, ..." and "1G resilvered, ..." while in progress
+    for (std::string_view word : {std::string_view("repaired"), std::string_view("resilvered")}) {
+        size_t pos = status.find(word);
+        if (pos == std::string_view::npos) {
+            continue;
+        }
+        size_t after = pos + word.size();
+        if (after < status.size() && status[after] == ',') {
+            std::string_view before = status.substr(0, pos > 0 ? pos - 1 : 0);
+            size_t start = before.rfind(' ');
+            scan.repaired = std::string(before.substr(start == std::string_view::npos ? 0 : start + 1));
+        } else {
+            std::string_view rest = status.substr(after);
+            scan.repaired = std::string(nextToken(rest));
+        }
+        parseSize(scan.repaired, scan.repaired_bytes);
+        break;
+    }
+
+    size_t with = status.find(" with ");
+    if (with != std::string_view::npos) {
+        std::string_view rest = status.substr(with + 6);
+        parseCounter(nextToken(rest), scan.errors);
+    }
+}
+
+} // namespace
+
+std::vector<ZfsPoolInfo> parseZpoolStatus(std::string_view output) {
+    std::vector<ZfsPoolInfo> pools;
+    ZfsPoolInfo* pool = nullptr;
+
+    // The key whose continuation lines follow, and where the scan text started
+    enum class Section { OTHER, SCAN, CONFIG };
+    Section section = Section::OTHER;
+    const char* scan_begin = nullptr;
+    const char* scan_end = nullptr;
+
+    // Open vdevs of the config, stack[d] is the vdev at depth d + 1
+    std::vector<ZfsVdev*> stack;
+    std::string vdev_class;
+    bool header_seen = false;
+
+    auto finishScan = [&]() {
+        if (pool && scan_begin) {
+            parseScan(std::string_view(scan_begin, scan_end - scan_begin), *pool);
+        }
+        scan_begin = nullptr;
+    };
+
+    while (!output.empty()) {
+        size_t eol = output.find('\n');
+        std::string_view line = output.substr(0, eol);
+        output.remove_prefix(eol == std::string_view::npos ? output.size() : eol + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        // Keys are right aligned at the start of the line, their continuation
+        // lines and the config start with a tab
+        if (!line.empty() && line[0] != '\t') {
+            std::string_view text = trimView(line);
+            size_t colon = text.find(':');
+            if (colon == std::string_view::npos || text.substr(0, colon).find(' ') != std::string_view::npos) {
+                continue;
+            }
+
+            std::string_view key = text.substr(0, colon);
+            std::string_view value = trimView(text.substr(colon + 1));
+            finishScan();
+            section = Section::OTHER;
+
+            if (key == "pool") {
+                pools.emplace_back();
+                pool = &pools.back();
+                pool->name = std::string(value);
+                pool->health = ZfsPoolHealth::UNKNOWN;
+                pool->scrub_active = false;
+                pool->resilver_active = false;
+                pool->scrub_errors = false;
+                pool->errors = 0;
+            } else if (!pool) {
+                continue;
+            } else if (key == "state") {
+                pool->state = std::string(value);
+            } else if (key == "scan") {
+                section = Section::SCAN;
+                scan_begin = value.data();
+                scan_end = value.data() + value.size();
+            } else if (key == "config") {
+                section = Section::CONFIG;
+                stack.clear();
+                vdev_class.clear();
+                header_seen = false;
+            } else if (key == "errors") {
+                // "No known data errors" or "N data errors, use '-v' for a list"
+                parseCounter(nextToken(value), pool->errors);
+            }
+            continue;
+        }
+
+        if (section == Section::SCAN) {
+            std::string_view text = trimView(line);
+            if (!text.empty()) {
+                scan_end = text.data() + text.size();
+            }
+            continue;
+        }
+
+        if (section != Section::CONFIG || line.size() < 2) {
+            continue;
+        }
+
+        // The depth of a vdev is given by two spaces of indentation per level
+        line.remove_prefix(1);
+        size_t indent = line.find_first_not_of(' ');
+        if (indent == std::string_view::npos) {
+            continue;
+        }
+        size_t depth = indent / 2;
+        line.remove_prefix(indent);
+
+        if (depth == 0) {
+            std::string_view rest = line;
+            std::string_view name = nextToken(rest);
+            stack.clear();
+            if (!header_seen && name == "NAME") {
+                header_seen = true;
+            } else if (isVdevClass(name)) {
+                vdev_class = std::string(name);
+            } else {
+                // The root of the pool, with the data vdevs below it
+                vdev_class.clear();
+            }
+            continue;
+        }
+
+        if (depth > stack.size() + 1) {
+            // Broken indentation, attach the vdev to the deepest open one
+            depth = stack.size() + 1;
+        }
+        stack.resize(depth - 1);
+
+        std::vector<ZfsVdev>& siblings = stack.empty() ? pool->vdevs : stack.back()->children;
+        siblings.emplace_back();
+        ZfsVdev& vdev = siblings.back();
+        parseVdevLine(line, vdev);
+        vdev.vdev_class = vdev_class;
+        stack.push_back(&vdev);
+    }
+
+    finishScan();
+    return pools;
+}
@@ -0,0 +1,71 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM led_ugreen
+
+#if !defined(__UGREEN_LED_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define __UGREEN_LED_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(ugreen_led_change_state,
+
+    TP_PROTO(u8 led_id, u8 command, u8 param1, u8 param2, u8 param3, u8 param4,
+             int rc, u64 duration_ns),
+
+    TP_ARGS(led_id, command, param1, param2, param3, param4, rc, duration_ns),
+
+    TP_STRUCT__entry(
+        __field(u8, led_id)
+        __field(u8, command)
+        __array(u8, params, 4)
+        __field(int, rc)
+        __field(u64, duration_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->led_id = led_id;
+        __entry->command = command;
+        __entry->params[0] = param1;
+        __entry->params[1] = param2;
+        __entry->params[2] = param3;
+        __entry->params[3] = param4;
+        __entry->rc = rc;
+        __entry->duration_ns = duration_ns;
+    ),
+
+    TP_printk("led=%u cmd=0x%02x params=(0x%02x, 0x%02x, 0x%02x, 0x%02x) rc=%d duration=%llu ns",
+        __entry->led_id, __entry->command,
+        __entry->params[0], __entry->params[1], __entry->params[2], __entry->params[3],
+        __entry->rc, __entry->duration_ns)
+);
+
+TRACE_EVENT(ugreen_led_get_state,
+
+    TP_PROTO(u8 led_id, u8 command, int rc, u64 duration_ns),
+
+    TP_ARGS(led_id, command, rc, duration_ns),
+
+    TP_STRUCT__entry(
+        __field(u8, led_id)
+        __field(u8, command)
+        __field(int, rc)
+        __field(u64, duration_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->led_id = led_id;
+        __entry->command = command;
+        __entry->rc = rc;
+        __entry->duration_ns = duration_ns;
+    ),
+
+    TP_printk("led=%u cmd=0x%02x rc=%d duration=%llu ns",
+        __entry->led_id, __entry->command, __entry->rc, __entry->duration_ns)
+);
+
+#endif // __UGREEN_LED_TRACE_H
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE led-ugreen-trace
+#include <trace/define_trace.h>
@@ -13,12 +13,19 @@
 #include <linux/uaccess.h>
 #include <linux/fs.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
 #include <linux/leds.h>
 #include <linux/proc_fs.h>
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 #include "led-ugreen.h"
 
+#define CREATE_TRACE_POINTS
+#include "led-ugreen-trace.h"
+
 #ifdef pr_fmt
 #undef pr_fmt
 #endif
@@ -28,10 +35,46 @@ static bool verbose = false;
 module_param(verbose, bool, 0644);
 MODULE_PARM_DESC(verbose, "Enable verbose output");
 
+static bool fast_probe = true;
+module_param(fast_probe, bool, 0644);
+MODULE_PARM_DESC(fast_probe, "Read each LED once at probe time and re-probe missing LEDs in the background");
+
+static bool preserve_state = false;
+module_param(preserve_state, bool, 0644);
+MODULE_PARM_DESC(preserve_state, "Keep the LED states found at probe time instead of resetting them");
+
+static struct dentry *ugreen_led_debugfs_root;
+
 static struct ugreen_led_state *lcdev_to_ugreen_led_state(struct led_classdev *led_cdev) {
     return container_of(led_cdev, struct ugreen_led_state, cdev);
 }
 
+static struct ugreen_led_stats *ugreen_led_get_stats(struct i2c_client *client, u8 led_id) {
+    struct ugreen_led_array *priv = i2c_get_clientdata(client);
+    return &priv->state[led_id].stats;
+}
+
+static void ugreen_led_stats_add_latency(struct ugreen_led_stats *stats, u64 start_ns) {
+    u64 latency_ns = ktime_get_ns() - start_ns;
+    stats->latency_total_ns += latency_ns;
+    if (latency_ns > stats->latency_max_ns)
+        stats->latency_max_ns = latency_ns;
+}
+
+// take the bus mutex and account the time spent waiting for it
+static void ugreen_led_lock(struct ugreen_led_array *priv, u8 led_id) {
+    struct ugreen_led_stats *stats = &priv->state[led_id].stats;
+    u64 start_ns = ktime_get_ns();
+
+    mutex_lock(&priv->mutex);
+
+    u64 wait_ns = ktime_get_ns() - start_ns;
+    stats->lock_count++;
+    stats->lock_wait_total_ns += wait_ns;
+    if (wait_ns > stats->lock_wait_max_ns)
+        stats->lock_wait_max_ns = wait_ns;
+}
+
 static int ugreen_led_change_state(
     struct i2c_client *client, 
     u8 led_id, 
@@ -55,7 +98,11 @@ static int ugreen_led_change_state(
     };
 
     // write the buffer to the I2C device by sending block data 
+    u64 start_ns = ktime_get_ns();
     s32 rc = i2c_smbus_write_i2c_block_data(client, led_id, 12, buf);
+    trace_ugreen_led_change_state(led_id, command, param1, param2, param3, param4,
+            rc, ktime_get_ns() - start_ns);
+    ugreen_led_get_stats(client, led_id)->write_xfers++;
 
     // check the return code
     if (rc < 0) {
@@ -72,7 +119,7 @@ static int ugreen_led_change_state(
 static int ugreen_led_get_state(
         struct i2c_client *client, 
         u8 led_id, 
-        struct ugreen_led_state *state
+        struct ugreen_led_value *state
 ) {
     if (!state) {
         pr_err("%s: invalid state buffer", __func__);
@@ -81,7 +128,12 @@ static int ugreen_led_get_state(
 
     // read the state of the LED from the I2C device
     u8 buf[11];
+    u64 start_ns = ktime_get_ns();
     s32 rc = i2c_smbus_read_i2c_block_data(client, 0x81 + led_id, 11, (u8 *)buf);
+    trace_ugreen_led_get_state(led_id, 0x81 + led_id, rc, ktime_get_ns() - start_ns);
+
+    struct ugreen_led_stats *stats = ugreen_led_get_stats(client, led_id);
+    stats->read_xfers++;
 
     // check the return code
     if (rc < 0) {
@@ -98,6 +150,7 @@ static int ugreen_led_get_state(
 
     // check the checksum
     if (sum == 0 || (sum != (((u16)buf[9] << 8) | buf[10]))) {
+        stats->checksum_failures++;
         return -1;
     }
 
@@ -138,150 +191,279 @@ static int ugreen_led_change_state_robust(
     u8 param3,
     u8 param4
 ) {
+    struct ugreen_led_stats *stats = ugreen_led_get_stats(client, led_id);
+    u64 start_ns = ktime_get_ns();
     int rc = 0;
+
+    stats->write_ops++;
+
     for (int i = 0; i < UGREEN_LED_CHANGE_STATE_RETRY_COUNT; ++i) {
 
         if (i == 0) usleep_range(500, 1500);
         else msleep(30);
 
-        if (i > 0) pr_debug("retrying %d", i);
+        if (i > 0) {
+            pr_debug("retrying %d", i);
+            stats->retries++;
+        }
 
         rc = ugreen_led_change_state(client, led_id, command, param1, param2, param3, param4);
         if (rc == 0) {
             usleep_range(1500, 2500);
             if (ugreen_led_get_last_command_status(client)) {
+                ugreen_led_stats_add_latency(stats, start_ns);
                 return 0;
             }
         }
     }
 
+    stats->write_failures++;
+    ugreen_led_stats_add_latency(stats, start_ns);
+
     return -1;
 }
 
 static int ugreen_led_get_state_robust(
         struct i2c_client *client, 
         u8 led_id, 
-        struct ugreen_led_state *state
+        struct ugreen_led_value *state
 ) {
+    struct ugreen_led_stats *stats = ugreen_led_get_stats(client, led_id);
+    u64 start_ns = ktime_get_ns();
     int rc = 0;
+
+    stats->read_ops++;
+
     for (int i = 0; i < UGREEN_LED_CHANGE_STATE_RETRY_COUNT; ++i) {
 
         if (i == 0) usleep_range(500, 1500);
         else msleep(30);
 
+        if (i > 0) stats->retries++;
+
         rc = ugreen_led_get_state(client, led_id, state);
-        if (rc == 0) return 0;
+        if (rc == 0) {
+            ugreen_led_stats_add_latency(stats, start_ns);
+            return 0;
+        }
     }
 
+    stats->read_failures++;
+    ugreen_led_stats_add_latency(stats, start_ns);
     state->status = UGREEN_LED_STATE_INVALID;
 
     return -1;
 }
 
-static void ugreen_led_turn_on_or_off_unlock(struct ugreen_led_array *priv, u8 led_id, bool on) {
+// bring the MCU state of a led in line with the requested one;
+// only called by the bus worker, with the bus mutex held
+static void ugreen_led_sync_unlock(struct ugreen_led_array *priv, u8 led_id, const struct ugreen_led_value *want) {
 
-    if (priv->state[led_id].status == (on ? UGREEN_LED_STATE_ON : UGREEN_LED_STATE_OFF)) {
-        return;
+    struct ugreen_led_value *hw = &priv->state[led_id].hw;
+    int rc;
+
+    if (hw->r != want->r || hw->g != want->g || hw->b != want->b) {
+        rc = ugreen_led_change_state_robust(priv->client, led_id, 0x02, want->r, want->g, want->b, 0);
+        if (rc == 0) {
+            hw->r = want->r;
+            hw->g = want->g;
+            hw->b = want->b;
+        } else if (verbose) {
+            pr_err("failed to set color of %d to 0x%02x%02x%02x", led_id, want->r, want->g, want->b);
+        }
     }
 
-    int rc = ugreen_led_change_state_robust(priv->client, led_id, 0x03, on ? 1 : 0, 0, 0, 0);
-    if (rc == 0) {
-        priv->state[led_id].status = on ? UGREEN_LED_STATE_ON : UGREEN_LED_STATE_OFF;
-    } else if (verbose) {
-        pr_err("failed to turn %d %s", led_id, on ? "on" : "off");
+    if (hw->brightness != want->brightness) {
+        rc = ugreen_led_change_state_robust(priv->client, led_id, 0x01, want->brightness, 0, 0, 0);
+        if (rc == 0) {
+            hw->brightness = want->brightness;
+        } else if (verbose) {
+            pr_err("failed to set brightness of %d to %d", led_id, want->brightness);
+        }
     }
-}
 
-static void ugreen_led_set_brightness_unlock(struct ugreen_led_array *priv, u8 led_id, enum led_brightness brightness) {
+    if (want->status == UGREEN_LED_STATE_BLINK || want->status == UGREEN_LED_STATE_BREATH) {
 
-    struct ugreen_led_state *state = priv->state + led_id;
+        bool is_blink = want->status == UGREEN_LED_STATE_BLINK;
 
-    if (brightness == 0) {
-        ugreen_led_turn_on_or_off_unlock(priv, led_id, false);
-    } else {
-        if (state->brightness != brightness) {
-            int rc = ugreen_led_change_state_robust(priv->client, led_id, 0x01, brightness, 0, 0, 0);
-            if (rc == 0) {
-                state->brightness = brightness;
-            } else if (verbose) {
-                pr_err("failed to set brightness of %d to %d", led_id, brightness);
-            }
+        if (hw->status == want->status && hw->t_on == want->t_on && hw->t_cycle == want->t_cycle)
+            return;
+
+        rc = ugreen_led_change_state_robust(priv->client, led_id, is_blink ? 0x04 : 0x05, 
+            (u8)(want->t_cycle >> 8), (u8)(want->t_cycle & 0xff), 
+            (u8)(want->t_on >> 8), (u8)(want->t_on & 0xff)
+        );
+
+        if (rc == 0) {
+            hw->t_on = want->t_on;
+            hw->t_cycle = want->t_cycle;
+            hw->status = want->status;
+        } else if (verbose) {
+            pr_err("failed to set %s of %d to %d %d", is_blink ? "blink" : "breath", 
+                    led_id, want->t_on, want->t_cycle);
         }
 
-        if (state->status == UGREEN_LED_STATE_OFF)
-            ugreen_led_turn_on_or_off_unlock(priv, led_id, true);
+    } else if (hw->status != want->status) {
+
+        bool on = want->status == UGREEN_LED_STATE_ON;
+
+        rc = ugreen_led_change_state_robust(priv->client, led_id, 0x03, on ? 1 : 0, 0, 0, 0);
+        if (rc == 0) {
+            hw->status = want->status;
+        } else if (verbose) {
+            pr_err("failed to turn %d %s", led_id, on ? "on" : "off");
+        }
     }
 }
 
-static void ugreen_led_set_color_unlock(struct ugreen_led_array *priv, u8 led_id, u8 r, u8 g, u8 b) {
+// the single owner of the bus: apply the pending states of all leds,
+// one led per turn, so a led stuck in retries delays the others by at 
+// most one sync, and repeated requests to a busy led are coalesced
+static void ugreen_led_bus_work(struct work_struct *work) {
 
-    struct ugreen_led_state *state = priv->state + led_id;
+    struct ugreen_led_array *priv = container_of(work, struct ugreen_led_array, bus_work);
+    bool has_pending;
 
-    if (!r && !g && !b) {
-        return ugreen_led_turn_on_or_off_unlock(priv, led_id, false);
-    }
+    do {
+        has_pending = false;
 
-    if (state->r != r || state->g != g || state->b != b) {
-        int rc = ugreen_led_change_state_robust(priv->client, led_id, 0x02, r, g, b, 0);
-        if (rc == 0) {
-            state->r = r;
-            state->g = g;
-            state->b = b;
-        } else if (verbose) {
-            pr_err("failed to set color of %d to 0x%02x%02x%02x", led_id, r, g, b);
+        for (int i = 0; i < UGREEN_MAX_LED_NUMBER; ++i) {
+
+            struct ugreen_led_state *state = priv->state + i;
+            struct ugreen_led_value want;
+            unsigned long flags;
+            bool pending;
+
+            spin_lock_irqsave(&priv->lock, flags);
+            pending = state->pending;
+            want = state->want;
+            state->pending = false;
+            spin_unlock_irqrestore(&priv->lock, flags);
+
+            if (!pending)
+                continue;
+
+            has_pending = true;
+
+            ugreen_led_lock(priv, i);
+            ugreen_led_sync_unlock(priv, i, &want);
+            mutex_unlock(&priv->mutex);
         }
+    } while (has_pending);
+}
+
+// mark the requested state of a led as pending, called with priv->lock held
+static void ugreen_led_post_unlock(struct ugreen_led_state *state) {
+    state->pending = true;
+    queue_work(system_long_wq, &state->priv->bus_work);
+}
+
+static void ugreen_led_post_on_or_off(struct ugreen_led_state *state, bool on) {
+
+    unsigned long flags;
+
+    spin_lock_irqsave(&state->priv->lock, flags);
+    state->want.status = on ? UGREEN_LED_STATE_ON : UGREEN_LED_STATE_OFF;
+    ugreen_led_post_unlock(state);
+    spin_unlock_irqrestore(&state->priv->lock, flags);
+}
+
+static void ugreen_led_post_brightness(struct ugreen_led_state *state, enum led_brightness brightness) {
+
+    unsigned long flags;
+
+    spin_lock_irqsave(&state->priv->lock, flags);
+
+    if (brightness == 0) {
+        state->want.status = UGREEN_LED_STATE_OFF;
+    } else {
+        state->want.brightness = brightness;
+        if (state->want.status == UGREEN_LED_STATE_OFF)
+            state->want.status = UGREEN_LED_STATE_ON;
     }
+
+    ugreen_led_post_unlock(state);
+    spin_unlock_irqrestore(&state->priv->lock, flags);
 }
 
-static void ugreen_led_set_blink_or_breath_unlock(struct ugreen_led_array *priv, u8 led_id, u16 t_on, u16 t_cycle, bool is_blink) {
+static void ugreen_led_post_color(struct ugreen_led_state *state, u8 r, u8 g, u8 b) {
 
-    int rc;
-    struct ugreen_led_state *state = priv->state + led_id;
-    u8 led_status = is_blink ? UGREEN_LED_STATE_BLINK : UGREEN_LED_STATE_BREATH;
+    unsigned long flags;
+
+    spin_lock_irqsave(&state->priv->lock, flags);
 
-    if (state->t_on == t_on && state->t_cycle == t_cycle && state->status == led_status) {
-        rc = 0;
+    if (!r && !g && !b) {
+        state->want.status = UGREEN_LED_STATE_OFF;
     } else {
-        rc = ugreen_led_change_state_robust(priv->client, led_id, is_blink ? 0x04 : 0x05, 
-            (u8)(t_cycle >> 8), (u8)(t_cycle & 0xff), 
-            (u8)(t_on >> 8), (u8)(t_on & 0xff)
-        );
+        state->want.r = r;
+        state->want.g = g;
+        state->want.b = b;
+    }
 
-        if (rc == 0) {
-            state->t_on = t_on;
-            state->t_cycle = t_cycle;
-            state->status = led_status;
-        } else if (verbose) {
-            pr_err("failed to set %s of %d to %d %d", is_blink ? "blink" : "breath", led_id, t_on, t_cycle);
-        }
+    ugreen_led_post_unlock(state);
+    spin_unlock_irqrestore(&state->priv->lock, flags);
+}
+
+static void ugreen_led_post_blink_or_breath(struct ugreen_led_state *state, u16 t_on, u16 t_cycle, bool is_blink) {
+
+    unsigned long flags;
+
+    spin_lock_irqsave(&state->priv->lock, flags);
+    state->want.t_on = t_on;
+    state->want.t_cycle = t_cycle;
+    state->want.status = is_blink ? UGREEN_LED_STATE_BLINK : UGREEN_LED_STATE_BREATH;
+    ugreen_led_post_unlock(state);
+    spin_unlock_irqrestore(&state->priv->lock, flags);
+}
+
+// leave the blink or breath mode, e.g., when a hardware pattern is cleared
+static void ugreen_led_post_solid(struct ugreen_led_state *state) {
+
+    unsigned long flags;
+
+    spin_lock_irqsave(&state->priv->lock, flags);
+
+    if (state->want.status == UGREEN_LED_STATE_BLINK || state->want.status == UGREEN_LED_STATE_BREATH) {
+        state->want.status = UGREEN_LED_STATE_ON;
+        ugreen_led_post_unlock(state);
     }
+
+    spin_unlock_irqrestore(&state->priv->lock, flags);
 }
 
-static int ugreen_led_set_brightness_blocking(struct led_classdev *cdev, enum led_brightness brightness) {
+// read the requested state of a led, which never waits for the bus
+static struct ugreen_led_value ugreen_led_read_cached(struct ugreen_led_state *state) {
 
-    struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
-    struct ugreen_led_array *priv = state->priv;
-    int led_id = state->led_id;
+    struct ugreen_led_value value;
+    unsigned long flags;
 
-    pr_debug("set brightness of %d to %d\n", led_id, brightness);
+    spin_lock_irqsave(&state->priv->lock, flags);
+    value = state->want;
+    spin_unlock_irqrestore(&state->priv->lock, flags);
 
-    mutex_lock(&priv->mutex);
-    ugreen_led_set_brightness_unlock(priv, led_id, brightness);
-    mutex_unlock(&priv->mutex);
+    return value;
+}
 
-    return 0;
+static void ugreen_led_set_brightness(struct led_classdev *cdev, enum led_brightness brightness) {
+
+    struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
+
+    pr_debug("set brightness of %d to %d\n", state->led_id, brightness);
+
+    ugreen_led_post_brightness(state, brightness);
 }
 
 static enum led_brightness ugreen_led_get_brightness(struct led_classdev *cdev) {
 
     struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
+    struct ugreen_led_value value = ugreen_led_read_cached(state);
 
     pr_debug("get brightness of %d\n", state->led_id);
 
-    if (!state->r && !state->g && !state->b)
+    if (!value.r && !value.g && !value.b)
         return LED_OFF;
 
-    return state->status == UGREEN_LED_STATE_OFF ? LED_OFF : state->brightness;
+    return value.status == UGREEN_LED_STATE_OFF ? LED_OFF : value.brightness;
 }
 
 static void truncate_blink_delay_time(unsigned long *delay_on, unsigned long *delay_off) {
@@ -296,22 +478,147 @@ static void truncate_blink_delay_time(unsigned long *delay_on, unsigned long *de
 static int ugreen_led_set_blink(struct led_classdev *cdev, unsigned long *delay_on, unsigned long *delay_off) {
 
     struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
-    struct ugreen_led_array *priv = state->priv;
-    int led_id = state->led_id;
 
     truncate_blink_delay_time(delay_on, delay_off);
 
-    pr_debug("set blink of %d to %lu %lu\n", led_id, *delay_on, *delay_off);
+    pr_debug("set blink of %d to %lu %lu\n", state->led_id, *delay_on, *delay_off);
 
-    mutex_lock(&priv->mutex);
+    ugreen_led_post_blink_or_breath(state, *delay_on, *delay_on + *delay_off, true);
 
-    ugreen_led_set_blink_or_breath_unlock(priv, led_id, *delay_on, *delay_on + *delay_off, true);
-    *delay_on = state->t_on;
-    *delay_off = state->t_cycle - state->t_on;
+    return 0;
+}
 
-    mutex_unlock(&priv->mutex);
+// recognize the hardware patterns that the MCU runs natively:
+//   "<brightness> <t_on> 0 <t_off>"      two-step on/off, mapped to blink
+//   "0 <t_rise> <brightness> <t_fall>"   linear ramp, mapped to breath
+// the same two shapes are emulated with the same waveforms when the MCU
+// cannot run them (finite repeat, or a step under 100ms)
+static bool ugreen_led_pattern_is_square(const struct led_pattern *pattern, u32 len) {
+    return len == 2 && pattern[0].brightness > 0 && pattern[1].brightness == 0;
+}
+
+static bool ugreen_led_pattern_to_hw(const struct led_pattern *pattern, u32 len, 
+        u8 *brightness, unsigned long *t_on, unsigned long *t_off, bool *is_blink) {
 
-    return state->status == UGREEN_LED_STATE_BLINK ? 0 : -EINVAL;
+    if (len != 2)
+        return false;
+
+    if (ugreen_led_pattern_is_square(pattern, len)) {
+        *is_blink = true;
+        *brightness = min_t(int, pattern[0].brightness, 0xff);
+    } else if (pattern[0].brightness == 0 && pattern[1].brightness > 0) {
+        *is_blink = false;
+        *brightness = min_t(int, pattern[1].brightness, 0xff);
+    } else {
+        return false;
+    }
+
+    *t_on = pattern[0].delta_t;
+    *t_off = pattern[1].delta_t;
+
+    // only take timings the MCU can run without truncation
+    return *t_on >= 100 && *t_on <= 0x7fff && *t_off >= 100 && *t_off <= 0x7fff;
+}
+
+// step through an emulated pattern; constant steps cost one brightness 
+// change, and ramps are quantized to a few changes, all of which are
+// coalesced by the bus worker if it falls behind. a square pattern holds
+// each step, like the blink it is mapped to in hardware
+static void ugreen_led_pattern_work(struct work_struct *work) {
+
+    struct ugreen_led_state *state = container_of(
+            to_delayed_work(work), struct ugreen_led_state, pattern_work);
+
+    const struct led_pattern *step = state->pattern + state->pattern_index;
+    const struct led_pattern *next = state->pattern + (state->pattern_index + 1) % state->pattern_len;
+
+    int brightness = step->brightness;
+    u32 delay = step->delta_t - state->pattern_elapsed;
+
+    if (!state->pattern_square && step->delta_t > 0 && next->brightness != step->brightness) {
+        u32 ramp_step = max_t(u32, UGREEN_LED_PATTERN_MIN_STEP_MS, 
+                step->delta_t / UGREEN_LED_PATTERN_RAMP_STEPS);
+
+        brightness += (next->brightness - step->brightness) * 
+            (int)state->pattern_elapsed / (int)step->delta_t;
+        delay = min_t(u32, delay, ramp_step);
+    }
+
+    brightness = clamp_t(int, brightness, 0, 0xff);
+    if (brightness != state->pattern_brightness) {
+        ugreen_led_post_brightness(state, brightness);
+        state->pattern_brightness = brightness;
+    }
+
+    if (state->pattern_len == 1)
+        return;
+
+    state->pattern_elapsed += delay;
+    if (state->pattern_elapsed >= step->delta_t) {
+        state->pattern_elapsed = 0;
+        if (++state->pattern_index == state->pattern_len) {
+            state->pattern_index = 0;
+            if (state->pattern_repeat > 0 && --state->pattern_repeat == 0)
+                return;
+        }
+    }
+
+    schedule_delayed_work(&state->pattern_work, msecs_to_jiffies(delay));
+}
+
+static int ugreen_led_pattern_clear(struct led_classdev *cdev) {
+
+    struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
+
+    cancel_delayed_work_sync(&state->pattern_work);
+    ugreen_led_post_solid(state);
+
+    return 0;
+}
+
+static int ugreen_led_pattern_set(struct led_classdev *cdev, 
+        struct led_pattern *pattern, u32 len, int repeat) {
+
+    struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
+    unsigned long t_on, t_off;
+    u8 brightness;
+    bool is_blink;
+
+    if (len == 0 || len > UGREEN_LED_MAX_PATTERN_LEN || repeat == 0)
+        return -EINVAL;
+
+    cancel_delayed_work_sync(&state->pattern_work);
+
+    if (repeat < 0 && ugreen_led_pattern_to_hw(pattern, len, &brightness, &t_on, &t_off, &is_blink)) {
+        pr_debug("set hw pattern of %d to %s %lu %lu\n", state->led_id, 
+                is_blink ? "blink" : "breath", t_on, t_off);
+        ugreen_led_post_brightness(state, brightness);
+        ugreen_led_post_blink_or_breath(state, t_on, t_on + t_off, is_blink);
+        return 0;
+    }
+
+    u32 duration = 0;
+    for (u32 i = 0; i < len; ++i)
+        duration += pattern[i].delta_t;
+
+    // a pattern without duration would spin the emulation
+    if (len > 1 && duration == 0)
+        return -EINVAL;
+
+    pr_debug("emulate pattern of %d with %u steps\n", state->led_id, len);
+
+    memcpy(state->pattern, pattern, len * sizeof(struct led_pattern));
+    state->pattern_len = len;
+    state->pattern_index = 0;
+    state->pattern_elapsed = 0;
+    state->pattern_repeat = repeat;
+    state->pattern_brightness = -1;
+    state->pattern_square = ugreen_led_pattern_is_square(pattern, len);
+
+    ugreen_led_post_solid(state);
+    schedule_delayed_work(&state->pattern_work, 0);
+
+    return 0;
 }
 
 static ssize_t color_store(struct device *dev, 
@@ -321,8 +628,6 @@ static ssize_t color_store(struct device *dev,
 
     struct led_classdev *cdev = dev_get_drvdata(dev);
     struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
-    struct ugreen_led_array *priv = state->priv;
-    int led_id = state->led_id;
     u8 r, g, b;
 
     int nrchars;
@@ -335,11 +640,9 @@ static ssize_t color_store(struct device *dev,
         return -EINVAL;
     }
 
-    pr_debug("set color of %d to 0x%02x%02x%02x\n", led_id, r, g, b);
+    pr_debug("set color of %d to 0x%02x%02x%02x\n", state->led_id, r, g, b);
 
-    mutex_lock(&priv->mutex);
-    ugreen_led_set_color_unlock(priv, led_id, r, g, b);
-    mutex_unlock(&priv->mutex);
+    ugreen_led_post_color(state, r, g, b);
 
     return size;
 }
@@ -347,8 +650,8 @@ static ssize_t color_store(struct device *dev,
 static ssize_t color_show(struct device *dev, struct device_attribute *attr, char *buf) {
 
     struct led_classdev *cdev = dev_get_drvdata(dev);
-    struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
-    return sprintf(buf, "%d %d %d\n", state->r, state->g, state->b);
+    struct ugreen_led_value value = ugreen_led_read_cached(lcdev_to_ugreen_led_state(cdev));
+    return sprintf(buf, "%d %d %d\n", value.r, value.g, value.b);
 }
 
 static DEVICE_ATTR_RW(color);
@@ -378,34 +681,28 @@ static ssize_t blink_type_store(struct device *dev,
         return -EINVAL;
     }
 
-    mutex_lock(&state->priv->mutex);
-
     if (blink_type == UGREEN_LED_STATE_ON) {
-        ugreen_led_turn_on_or_off_unlock(state->priv, state->led_id, true);
+        ugreen_led_post_on_or_off(state, true);
     } else {
         truncate_blink_delay_time(&delay_on, &delay_off);
-        ugreen_led_set_blink_or_breath_unlock(state->priv, state->led_id, 
+        ugreen_led_post_blink_or_breath(state, 
                 (u16)delay_on, (u16)(delay_on + delay_off),
                 blink_type == UGREEN_LED_STATE_BLINK ? true : false);
     }
 
-    mutex_unlock(&state->priv->mutex);
-
     return size;
 }
 
 static ssize_t blink_type_show(struct device *dev, struct device_attribute *attr, char *buf) {
 
     struct led_classdev *cdev = dev_get_drvdata(dev);
-    struct ugreen_led_state *state = lcdev_to_ugreen_led_state(cdev);
+    struct ugreen_led_value value = ugreen_led_read_cached(lcdev_to_ugreen_led_state(cdev));
 
     ssize_t size = 0;
 
-    mutex_lock(&state->priv->mutex);
-    u8 status = state->status;
-    int delay_on = state->t_on;
-    int delay_off = state->t_cycle - state->t_on;
-    mutex_unlock(&state->priv->mutex);
+    u8 status = value.status;
+    int delay_on = value.t_on;
+    int delay_off = value.t_cycle - value.t_on;
 
     if (status == UGREEN_LED_STATE_BLINK) {
         size += sprintf(buf, "none [blink] breath\n");
@@ -429,20 +726,17 @@ static DEVICE_ATTR_RW(blink_type);
 static ssize_t status_show(struct device *dev, struct device_attribute *attr, char *buf) {
 
     struct led_classdev *cdev = dev_get_drvdata(dev);
-    struct ugreen_led_state state = *lcdev_to_ugreen_led_state(cdev);
+    struct ugreen_led_value value = ugreen_led_read_cached(lcdev_to_ugreen_led_state(cdev));
 
-    mutex_lock(&state.priv->mutex);
-    int status = state.status;
+    int status = value.status;
     if (status >= ARRAY_SIZE(ugreen_led_state_name)) {
         status = UGREEN_LED_STATE_INVALID;
     }
-    ssize_t size = sprintf(buf, "%s %d %d %d %d %d %d\n", 
-            ugreen_led_state_name[state.status], (int)state.brightness, 
-            (int)state.r, (int)state.g, (int)state.b,
-            (int)state.t_on, (int)(state.t_cycle - state.t_on));
-    mutex_unlock(&state.priv->mutex);
 
-    return size;
+    return sprintf(buf, "%s %d %d %d %d %d %d\n", 
+            ugreen_led_state_name[status], (int)value.brightness, 
+            (int)value.r, (int)value.g, (int)value.b,
+            (int)value.t_on, (int)(value.t_cycle - value.t_on));
 }
 
 static DEVICE_ATTR_RO(status);
@@ -456,10 +750,159 @@ static struct attribute *ugreen_led_attrs[] = {
 
 ATTRIBUTE_GROUPS(ugreen_led);
 
+static const char *ugreen_led_name[] = {
+    "power", "netdev", "disk1", "disk2", "disk3", "disk4", "disk5", "disk6", "disk7", "disk8"
+};
+
+static int ugreen_led_stats_show(struct seq_file *m, void *v) {
+
+    struct ugreen_led_array *priv = m->private;
+
+    seq_printf(m, "%-8s %10s %10s %8s %8s %10s %8s %8s %12s %12s %12s %12s\n",
+            "led", "write_ops", "writes", "retries", "failed", "read_ops", "reads", "cksum",
+            "lat_avg_us", "lat_max_us", "lock_avg_us", "lock_max_us");
+
+    for (int i = 0; i < UGREEN_MAX_LED_NUMBER; ++i) {
+
+        const struct ugreen_led_stats *stats = &priv->state[i].stats;
+        u64 num_ops = stats->write_ops + stats->read_ops;
+
+        if (!priv->state[i].registered && num_ops == 0)
+            continue;
+
+        seq_printf(m, "%-8s %10llu %10llu %8llu %8llu %10llu %8llu %8llu %12llu %12llu %12llu %12llu\n",
+                i < ARRAY_SIZE(ugreen_led_name) ? ugreen_led_name[i] : "unknown",
+                stats->write_ops, stats->write_xfers, stats->retries,
+                stats->write_failures + stats->read_failures,
+                stats->read_ops, stats->read_xfers, stats->checksum_failures,
+                num_ops ? div64_u64(stats->latency_total_ns, num_ops) / 1000 : 0,
+                stats->latency_max_ns / 1000,
+                stats->lock_count ? div64_u64(stats->lock_wait_total_ns, stats->lock_count) / 1000 : 0,
+                stats->lock_wait_max_ns / 1000);
+    }
+
+    return 0;
+}
+
+static int ugreen_led_stats_open(struct inode *inode, struct file *file) {
+    return single_open(file, ugreen_led_stats_show, inode->i_private);
+}
+
+// writing anything to the stats file resets the counters
+static ssize_t ugreen_led_stats_write(struct file *file, 
+        const char __user *buf, size_t size, loff_t *ppos) {
+
+    struct ugreen_led_array *priv = ((struct seq_file *)file->private_data)->private;
+
+    mutex_lock(&priv->mutex);
+    for (int i = 0; i < UGREEN_MAX_LED_NUMBER; ++i) {
+        memset(&priv->state[i].stats, 0, sizeof(struct ugreen_led_stats));
+    }
+    mutex_unlock(&priv->mutex);
+
+    return size;
+}
+
+static const struct file_operations ugreen_led_stats_fops = {
+    .owner   = THIS_MODULE,
+    .open    = ugreen_led_stats_open,
+    .read    = seq_read,
+    .write   = ugreen_led_stats_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+// set up the cached state of a probed led and post its initial state;
+// the bus worker skips writes if the led already has the requested state
+static void ugreen_led_init_state(struct ugreen_led_array *priv, u8 led_id) {
+
+    struct ugreen_led_state *state = priv->state + led_id;
+    struct ugreen_led_value *hw = &state->hw;
+    unsigned long flags;
+
+    pr_info("probed led id %d, status %d, rgb 0x%02x%02x%02x, "
+            "brightness %d, t_on %d, t_cycle %d\n", led_id, 
+            hw->status, hw->r, hw->g, hw->b,
+            hw->brightness, hw->t_on, hw->t_cycle);
+
+    spin_lock_irqsave(&priv->lock, flags);
+    state->want = *hw;
+    spin_unlock_irqrestore(&priv->lock, flags);
+
+    if (preserve_state)
+        return;
+
+    ugreen_led_post_brightness(state, 128);
+    ugreen_led_post_color(state, 0xff, 0xff, 0xff);
+}
+
+static int ugreen_led_register(struct ugreen_led_array *priv, u8 led_id) {
+
+    struct ugreen_led_state *state = priv->state + led_id;
+
+    // register the brightness control
+    if (led_id < ARRAY_SIZE(ugreen_led_name))
+        state->cdev.name = ugreen_led_name[led_id];
+    else state->cdev.name = "unknown";
+
+    state->cdev.brightness = ugreen_led_get_brightness(&state->cdev);
+    state->cdev.max_brightness = 0xff;
+    state->cdev.brightness_set = ugreen_led_set_brightness;
+    state->cdev.brightness_get = ugreen_led_get_brightness;
+    state->cdev.groups = ugreen_led_groups;
+    state->cdev.blink_set = ugreen_led_set_blink;
+    state->cdev.pattern_set = ugreen_led_pattern_set;
+    state->cdev.pattern_clear = ugreen_led_pattern_clear;
+
+    if (led_id == 1) {
+        state->cdev.default_trigger = "netdev";
+    } else if (led_id >= 2) {
+        state->cdev.default_trigger = "oneshot";
+    }
+
+    int rc = led_classdev_register(&priv->client->dev, &state->cdev);
+    if (rc < 0) {
+        pr_err("failed to register led %s, err %d", state->cdev.name, rc);
+        return rc;
+    }
+
+    state->registered = true;
+
+    return 0;
+}
+
+// the fast probe reads every led only once, so a slot that missed it
+// (absent, or a transient bus error) gets one robust read here
+static void ugreen_led_reprobe_work(struct work_struct *work) {
+
+    struct ugreen_led_array *priv = container_of(
+            to_delayed_work(work), struct ugreen_led_array, reprobe_work);
+
+    for (int i = 0; i < UGREEN_MAX_LED_NUMBER; ++i) {
+
+        struct ugreen_led_state *state = priv->state + i;
+        if (state->registered)
+            continue;
+
+        // the robust read is several transfers, none of which may interleave
+        // with the bus worker or a reprobe of another slot
+        ugreen_led_lock(priv, i);
+        int rc = ugreen_led_get_state_robust(priv->client, i, &state->hw);
+        mutex_unlock(&priv->mutex);
+
+        if (rc != 0)
+            continue;
+
+        ugreen_led_init_state(priv, i);
+        ugreen_led_register(priv, i);
+    }
+}
+
 static int ugreen_led_probe(struct i2c_client *client) {
 
     pr_info ("i2c probed");
 
+    ktime_t probe_start = ktime_get();
     struct ugreen_led_array *priv;
     
     priv = devm_kzalloc(&client->dev, sizeof(struct ugreen_led_array), GFP_KERNEL);
@@ -470,66 +913,52 @@ static int ugreen_led_probe(struct i2c_client *client) {
     priv->client = client;
 
     mutex_init(&priv->mutex);
+    spin_lock_init(&priv->lock);
+    INIT_WORK(&priv->bus_work, ugreen_led_bus_work);
+    INIT_DELAYED_WORK(&priv->reprobe_work, ugreen_led_reprobe_work);
 
-    // probe and initialize leds
-    for (int i = 0; i < UGREEN_MAX_LED_NUMBER; ++i) {
+    i2c_set_clientdata(client, priv);
 
-        priv->state[i].priv = priv;
-        priv->state[i].led_id = i;
+    priv->debugfs_dir = debugfs_create_dir(dev_name(&client->dev), ugreen_led_debugfs_root);
+    debugfs_create_file("stats", 0600, priv->debugfs_dir, priv, &ugreen_led_stats_fops);
 
-        ugreen_led_get_state_robust(client, i, priv->state + i);
+    // probe leds, the bus worker is not running yet
+    int num_missing = 0;
+    for (int i = 0; i < UGREEN_MAX_LED_NUMBER; ++i) {
 
         struct ugreen_led_state *state = priv->state + i;
-        if (state->status != UGREEN_LED_STATE_INVALID) {
-
-            pr_info("probed led id %d, status %d, rgb 0x%02x%02x%02x, "
-                    "brightness %d, t_on %d, t_cycle %d\n", i, 
-                    state->status, state->r, state->g, state->b,
-                    state->brightness, state->t_on, state->t_cycle);
-
-            ugreen_led_set_brightness_unlock(priv, i, 128);
-            ugreen_led_set_color_unlock(priv, i, 0xff, 0xff, 0xff);
-
+        state->priv = priv;
+        state->led_id = i;
+        INIT_DELAYED_WORK(&state->pattern_work, ugreen_led_pattern_work);
+
+        if (!fast_probe) {
+            ugreen_led_get_state_robust(client, i, &state->hw);
+        } else if (ugreen_led_get_state(client, i, &state->hw) != 0) {
+            state->hw.status = UGREEN_LED_STATE_INVALID;
         }
-    }
-
-    i2c_set_clientdata(client, priv);
-
-    mutex_lock(&priv->mutex);
 
-    // register leds class devices
-    const char *led_name[] = {
-        "power", "netdev", "disk1", "disk2", "disk3", "disk4", "disk5", "disk6", "disk7", "disk8"
-    };
+        if (state->hw.status == UGREEN_LED_STATE_INVALID)
+            ++num_missing;
+    }
 
+    // initialize and register leds class devices
     for (int i = 0; i < UGREEN_MAX_LED_NUMBER; ++i) {
 
-        struct ugreen_led_state *state = priv->state + i;
-        if (state->status == UGREEN_LED_STATE_INVALID)
+        if (priv->state[i].hw.status == UGREEN_LED_STATE_INVALID)
             continue;
 
-        // register the brightness control
-        if (i < ARRAY_SIZE(led_name))
-            state->cdev.name = led_name[i];
-        else state->cdev.name = "unknown";
-
-        state->cdev.brightness = state->cdev.brightness;
-        state->cdev.max_brightness = 0xff;
-        state->cdev.brightness_set_blocking = ugreen_led_set_brightness_blocking;
-        state->cdev.brightness_get = ugreen_led_get_brightness;
-        state->cdev.groups = ugreen_led_groups;
-        state->cdev.blink_set = ugreen_led_set_blink;
-
-        if (i == 1) {
-            state->cdev.default_trigger = "netdev";
-        } else if (i >= 2) {
-            state->cdev.default_trigger = "oneshot";
-        }
+        ugreen_led_init_state(priv, i);
+        ugreen_led_register(priv, i);
+    }
 
-        led_classdev_register(&client->dev, &state->cdev);
+    if (fast_probe && num_missing > 0) {
+        schedule_delayed_work(&priv->reprobe_work, 
+                msecs_to_jiffies(UGREEN_LED_REPROBE_DELAY_MS));
     }
 
-    mutex_unlock(&priv->mutex);
+    pr_info("%s probe finished in %lld us, %d leds missing", 
+            fast_probe ? "fast" : "robust", 
+            ktime_us_delta(ktime_get(), probe_start), num_missing);
 
     return 0;
 }
@@ -543,15 +972,22 @@ ugreen_led_remove(struct i2c_client *client) {
 
     struct ugreen_led_array *priv = i2c_get_clientdata(client);
 
+    cancel_delayed_work_sync(&priv->reprobe_work);
+    debugfs_remove_recursive(priv->debugfs_dir);
+
     for (int i = 0; i < UGREEN_MAX_LED_NUMBER; ++i) {
 
         struct ugreen_led_state *state = priv->state + i;
-        if (state->status == UGREEN_LED_STATE_INVALID)
+        if (!state->registered)
             continue;
 
         led_classdev_unregister(&state->cdev);
+        cancel_delayed_work_sync(&state->pattern_work);
     }
 
+    // apply the states posted while unregistering, e.g., turning leds off
+    flush_work(&priv->bus_work);
+
     mutex_destroy(&priv->mutex);
 
     pr_info ("i2c removed");
@@ -586,12 +1022,14 @@ static struct i2c_driver ugreen_led_driver = {
 
 static int __init ugreen_led_init(void) {
     pr_info ("initializing");
+    ugreen_led_debugfs_root = debugfs_create_dir(MODULE_NAME, NULL);
     i2c_add_driver(&ugreen_led_driver);
     return 0;
 }
 
 static void __exit ugreen_led_exit(void) {
     i2c_del_driver(&ugreen_led_driver);
+    debugfs_remove_recursive(ugreen_led_debugfs_root);
     pr_info ("exited");
 }
 
@@ -3,7 +3,9 @@
 
 #include <linux/types.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
 #include <linux/leds.h>
+#include <linux/workqueue.h>
 
 
 #define MODULE_NAME             ( "led-ugreen" )
@@ -14,6 +16,16 @@
 #define UGREEN_MAX_LED_NUMBER           ( 10 )
 #define UGREEN_LED_CHANGE_STATE_RETRY_COUNT   ( 5 )
 
+// patterns that the MCU cannot run by itself are emulated in steps 
+// of at least UGREEN_LED_PATTERN_MIN_STEP_MS, with at most 
+// UGREEN_LED_PATTERN_RAMP_STEPS brightness changes per ramp
+#define UGREEN_LED_MAX_PATTERN_LEN      ( 16 )
+#define UGREEN_LED_PATTERN_MIN_STEP_MS  ( 100 )
+#define UGREEN_LED_PATTERN_RAMP_STEPS   ( 8 )
+
+// slots that fail the single read of a fast probe are re-probed later
+#define UGREEN_LED_REPROBE_DELAY_MS     ( 1000 )
+
 #define UGREEN_LED_STATE_OFF        ( 0 )
 #define UGREEN_LED_STATE_ON         ( 1 )
 #define UGREEN_LED_STATE_BLINK      ( 2 )
@@ -24,21 +36,53 @@ static const char *ugreen_led_state_name[] = { "off", "on", "blink", "breath", "
 
 struct ugreen_led_array;
 
-struct ugreen_led_state {
+// per-led counters exported through debugfs
+struct ugreen_led_stats {
+    u64 write_ops, write_xfers, write_failures, retries;
+    u64 read_ops, read_xfers, read_failures, checksum_failures;
+    u64 latency_total_ns, latency_max_ns;
+    u64 lock_count, lock_wait_total_ns, lock_wait_max_ns;
+};
+
+struct ugreen_led_value {
     u8 status;
     u8 r, g, b;
     u8 brightness;
     u16 t_on, t_cycle;
+};
+
+struct ugreen_led_state {
+    // the state requested by callers, protected by priv->lock
+    struct ugreen_led_value want;
+    bool pending;
+
+    // the state last confirmed by the MCU, owned by the bus worker
+    struct ugreen_led_value hw;
+
+    // software emulation of patterns the MCU cannot run
+    struct delayed_work pattern_work;
+    struct led_pattern pattern[UGREEN_LED_MAX_PATTERN_LEN];
+    u32 pattern_len, pattern_index, pattern_elapsed;
+    int pattern_repeat;
+    int pattern_brightness;
+    bool pattern_square;
 
     u8 led_id;
+    bool registered;
+    struct ugreen_led_stats stats;
     struct led_classdev cdev;
     struct ugreen_led_array *priv;
 };
 
 struct ugreen_led_array {
     struct i2c_client *client;
-    struct mutex mutex;
+    struct mutex mutex;         // serializes transactions on the bus
+    spinlock_t lock;            // protects the requested states
+    struct work_struct bus_work;
     struct ugreen_led_state state[UGREEN_MAX_LED_NUMBER];
+
+    struct delayed_work reprobe_work;
+    struct dentry *debugfs_dir;
 };
 
 
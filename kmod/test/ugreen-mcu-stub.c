@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ *     Emulated UGREEN NAS LED controller for testing led-ugreen.
+ *
+ *	The stock i2c-stub exposes a flat array of registers, which cannot
+ *	hold the overlapping, checksummed 11-byte state windows that the MCU
+ *	returns at 0x81 + led_id. This module registers an SMBus adapter with
+ *	a single device at 0x3a that implements the MCU protocol instead:
+ *
+ *	  - 12-byte block writes to register led_id change the LED state,
+ *	  - byte reads of 0x80 return the status of the last write (1 = ok),
+ *	  - 11-byte block reads of 0x81 + led_id return the LED state.
+ *
+ *	Writes, rejected writes and reads are counted per LED, and transfers
+ *	can be slowed down or made to fail to exercise the retry paths.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/delay.h>
+#include <linux/i2c.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#ifdef pr_fmt
+#undef pr_fmt
+#endif
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#define UGREEN_STUB_NAME            ( "ugreen-mcu-stub" )
+#define UGREEN_STUB_ADAPTER_NAME    ( "UGREEN MCU stub" )
+#define UGREEN_STUB_ADDR            ( 0x3a )
+#define UGREEN_STUB_MAX_LEDS        ( 10 )
+
+// same encoding as the status byte of the real MCU (see led-ugreen.h)
+#define UGREEN_STUB_STATE_OFF       ( 0 )
+#define UGREEN_STUB_STATE_ON        ( 1 )
+#define UGREEN_STUB_STATE_BLINK     ( 2 )
+#define UGREEN_STUB_STATE_BREATH    ( 3 )
+
+static unsigned int num_leds = UGREEN_STUB_MAX_LEDS;
+module_param(num_leds, uint, 0444);
+MODULE_PARM_DESC(num_leds, "Number of LEDs present, the other slots read back as invalid");
+
+static unsigned int xfer_delay_us = 0;
+module_param(xfer_delay_us, uint, 0644);
+MODULE_PARM_DESC(xfer_delay_us, "Time spent by each transfer, to emulate a slow bus");
+
+static unsigned int fail_every = 0;
+module_param(fail_every, uint, 0644);
+MODULE_PARM_DESC(fail_every, "Reject every N-th write with a failed status (0 to disable)");
+
+static unsigned int corrupt_every = 0;
+module_param(corrupt_every, uint, 0644);
+MODULE_PARM_DESC(corrupt_every, "Return a bad checksum for every N-th state read (0 to disable)");
+
+struct ugreen_stub_led {
+    u8 status, brightness, r, g, b;
+    u16 t_on, t_cycle;
+
+    u64 writes, rejected, reads;
+};
+
+static struct ugreen_stub_led ugreen_stub_leds[UGREEN_STUB_MAX_LEDS];
+static u8 ugreen_stub_last_status;
+static u64 ugreen_stub_write_seq, ugreen_stub_read_seq, ugreen_stub_status_reads;
+static DEFINE_MUTEX(ugreen_stub_lock);
+static struct dentry *ugreen_stub_debugfs_dir;
+
+static void ugreen_stub_reset_leds(void) {
+    for (int i = 0; i < UGREEN_STUB_MAX_LEDS; ++i) {
+        // a state of all zeros has a zero checksum, which the driver
+        // rejects, so start the LEDs on and white like the firmware
+        ugreen_stub_leds[i] = (struct ugreen_stub_led) {
+            .status = UGREEN_STUB_STATE_ON,
+            .brightness = 128,
+            .r = 255, .g = 255, .b = 255,
+        };
+    }
+}
+
+// apply a 12-byte write, and return the status byte reported at 0x80
+static u8 ugreen_stub_write(u8 led_id, const u8 *buf, u8 len) {
+
+    if (led_id >= num_leds || len != 12 || buf[0] != led_id)
+        return 0;
+
+    struct ugreen_stub_led *led = &ugreen_stub_leds[led_id];
+
+    u16 sum = 0;
+    for (int i = 1; i < 10; ++i) {
+        sum += buf[i];
+    }
+
+    if (buf[1] != 0xa0 || buf[2] != 0x01 || buf[3] != 0x00 || buf[4] != 0x00
+            || sum != (((u16)buf[10] << 8) | buf[11])) {
+        led->rejected++;
+        return 0;
+    }
+
+    if (fail_every && ++ugreen_stub_write_seq % fail_every == 0) {
+        led->rejected++;
+        return 0;
+    }
+
+    const u8 *params = &buf[6];
+
+    switch (buf[5]) {
+        case 0x01:
+            led->brightness = params[0];
+            break;
+        case 0x02:
+            led->r = params[0];
+            led->g = params[1];
+            led->b = params[2];
+            break;
+        case 0x03:
+            led->status = params[0] ? UGREEN_STUB_STATE_ON : UGREEN_STUB_STATE_OFF;
+            break;
+        case 0x04:
+        case 0x05:
+            led->status = buf[5] == 0x04 ? UGREEN_STUB_STATE_BLINK : UGREEN_STUB_STATE_BREATH;
+            led->t_cycle = ((u16)params[0] << 8) | params[1];
+            led->t_on = ((u16)params[2] << 8) | params[3];
+            break;
+        default:
+            led->rejected++;
+            return 0;
+    }
+
+    led->writes++;
+    return 1;
+}
+
+// fill an 11-byte state read of register 0x81 + led_id
+static void ugreen_stub_read(u8 led_id, u8 *buf, u8 len) {
+
+    u8 state[11] = { 0 };
+
+    // absent LEDs read back as zeros, i.e. an invalid checksum
+    if (led_id < num_leds) {
+
+        struct ugreen_stub_led *led = &ugreen_stub_leds[led_id];
+
+        state[0] = led->status;
+        state[1] = led->brightness;
+        state[2] = led->r;
+        state[3] = led->g;
+        state[4] = led->b;
+        state[5] = (u8)(led->t_cycle >> 8);
+        state[6] = (u8)(led->t_cycle & 0xff);
+        state[7] = (u8)(led->t_on >> 8);
+        state[8] = (u8)(led->t_on & 0xff);
+
+        u16 sum = 0;
+        for (int i = 0; i < 9; ++i) {
+            sum += state[i];
+        }
+
+        if (corrupt_every && ++ugreen_stub_read_seq % corrupt_every == 0)
+            sum ^= 0x5a;
+
+        state[9] = (u8)(sum >> 8);
+        state[10] = (u8)(sum & 0xff);
+
+        led->reads++;
+    }
+
+    memcpy(buf, state, min_t(u8, len, sizeof(state)));
+}
+
+static s32 ugreen_stub_xfer(struct i2c_adapter *adap, u16 addr, unsigned short flags,
+        char read_write, u8 command, int size, union i2c_smbus_data *data) {
+
+    if (addr != UGREEN_STUB_ADDR)
+        return -ENXIO;
+
+    if (xfer_delay_us)
+        usleep_range(xfer_delay_us, xfer_delay_us + xfer_delay_us / 4 + 1);
+
+    s32 rc = 0;
+
+    mutex_lock(&ugreen_stub_lock);
+
+    switch (size) {
+        case I2C_SMBUS_QUICK:
+            break;
+
+        case I2C_SMBUS_BYTE_DATA:
+            if (read_write == I2C_SMBUS_READ && command == 0x80) {
+                data->byte = ugreen_stub_last_status;
+                ugreen_stub_status_reads++;
+            } else {
+                rc = -EOPNOTSUPP;
+            }
+            break;
+
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+            if (data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+                rc = -EINVAL;
+            } else if (read_write == I2C_SMBUS_WRITE) {
+                ugreen_stub_last_status = ugreen_stub_write(command, &data->block[1], data->block[0]);
+            } else if (command > 0x80 && command <= 0x80 + UGREEN_STUB_MAX_LEDS) {
+                ugreen_stub_read(command - 0x81, &data->block[1], data->block[0]);
+            } else {
+                rc = -EOPNOTSUPP;
+            }
+            break;
+
+        default:
+            rc = -EOPNOTSUPP;
+    }
+
+    mutex_unlock(&ugreen_stub_lock);
+
+    return rc;
+}
+
+static u32 ugreen_stub_functionality(struct i2c_adapter *adap) {
+    return I2C_FUNC_SMBUS_QUICK | I2C_FUNC_SMBUS_BYTE_DATA | I2C_FUNC_SMBUS_I2C_BLOCK;
+}
+
+static const struct i2c_algorithm ugreen_stub_algorithm = {
+    .functionality  = ugreen_stub_functionality,
+    .smbus_xfer     = ugreen_stub_xfer,
+};
+
+static struct i2c_adapter ugreen_stub_adapter = {
+    .owner  = THIS_MODULE,
+    .algo   = &ugreen_stub_algorithm,
+    .name   = UGREEN_STUB_ADAPTER_NAME,
+};
+
+static int ugreen_stub_leds_show(struct seq_file *m, void *v) {
+
+    mutex_lock(&ugreen_stub_lock);
+
+    seq_printf(m, "%-4s %6s %10s %4s %4s %4s %6s %7s %10s %10s %10s\n",
+            "led", "status", "brightness", "r", "g", "b", "t_on", "t_cycle",
+            "writes", "rejected", "reads");
+
+    for (unsigned int i = 0; i < num_leds; ++i) {
+
+        const struct ugreen_stub_led *led = &ugreen_stub_leds[i];
+
+        seq_printf(m, "%-4u %6u %10u %4u %4u %4u %6u %7u %10llu %10llu %10llu\n",
+                i, led->status, led->brightness, led->r, led->g, led->b,
+                led->t_on, led->t_cycle, led->writes, led->rejected, led->reads);
+    }
+
+    seq_printf(m, "status_reads %llu\n", ugreen_stub_status_reads);
+
+    mutex_unlock(&ugreen_stub_lock);
+
+    return 0;
+}
+
+static int ugreen_stub_leds_open(struct inode *inode, struct file *file) {
+    return single_open(file, ugreen_stub_leds_show, NULL);
+}
+
+// writing anything to the leds file resets the counters, but not the states
+static ssize_t ugreen_stub_leds_write(struct file *file,
+        const char __user *buf, size_t size, loff_t *ppos) {
+
+    mutex_lock(&ugreen_stub_lock);
+    for (int i = 0; i < UGREEN_STUB_MAX_LEDS; ++i) {
+        ugreen_stub_leds[i].writes = 0;
+        ugreen_stub_leds[i].rejected = 0;
+        ugreen_stub_leds[i].reads = 0;
+    }
+    ugreen_stub_status_reads = 0;
+    mutex_unlock(&ugreen_stub_lock);
+
+    return size;
+}
+
+static const struct file_operations ugreen_stub_leds_fops = {
+    .owner   = THIS_MODULE,
+    .open    = ugreen_stub_leds_open,
+    .read    = seq_read,
+    .write   = ugreen_stub_leds_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static int __init ugreen_stub_init(void) {
+
+    if (num_leds > UGREEN_STUB_MAX_LEDS)
+        num_leds = UGREEN_STUB_MAX_LEDS;
+
+    ugreen_stub_reset_leds();
+
+    int rc = i2c_add_adapter(&ugreen_stub_adapter);
+    if (rc) {
+        pr_err("failed to add the adapter, err %d", rc);
+        return rc;
+    }
+
+    ugreen_stub_debugfs_dir = debugfs_create_dir(UGREEN_STUB_NAME, NULL);
+    debugfs_create_file("leds", 0600, ugreen_stub_debugfs_dir, NULL, &ugreen_stub_leds_fops);
+
+    pr_info("emulating %u leds on %s", num_leds, dev_name(&ugreen_stub_adapter.dev));
+    return 0;
+}
+
+static void __exit ugreen_stub_exit(void) {
+    debugfs_remove_recursive(ugreen_stub_debugfs_dir);
+    i2c_del_adapter(&ugreen_stub_adapter);
+}
+
+module_init(ugreen_stub_init);
+module_exit(ugreen_stub_exit);
+
+MODULE_DESCRIPTION("Emulated UGREEN NAS LED controller for testing led-ugreen");
+MODULE_LICENSE("GPL v2");
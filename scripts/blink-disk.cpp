@@ -1,72 +1,850 @@
-#include <fstream>
-#include <thread>
 #include <vector>
 #include <iostream>
 #include <string>
-#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <climits>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+// /proc/diskstats has up to 17 counters after the device name (kernel 5.5+),
+// older kernels print 11 or 15 of them and the rest stay zero
+constexpr int DISKSTATS_FIELDS = 17;
+constexpr int DEVICE_NAME_LEN = 32;
+
+// counters of /proc/diskstats used to measure the load
+enum { DS_READ_IOS = 0, DS_READ_SECTORS = 2, DS_WRITE_IOS = 4, DS_WRITE_SECTORS = 6 };
+
+// the load of a disk is quantized to this many levels (0 = idle), so the
+// LED attributes are only written when the level changes
+constexpr int LOAD_LEVELS = 8;
+
+// throughput below this is considered idle in the log scale of the load
+constexpr double MIN_LOAD_BPS = 4096;
+
+// blink cycle of the lowest and the highest load level in rate mode
+constexpr int RATE_MAX_CYCLE_MS = 400;
+constexpr int RATE_MIN_CYCLE_MS = 50;
+
+enum class indication_t { SHOT, RATE, BRIGHTNESS };
+
+// a device that failed to link to the blkdev trigger (e.g., its /dev node
+// is not created yet after a hotplug) is retried this often and this many times
+constexpr int BLKDEV_RETRY_MS = 500;
+constexpr int BLKDEV_RETRY_COUNT = 20;
+
+// keep polling at the fast interval for this long after the last activity,
+// then double the interval on every idle tick up to the maximum sleep time
+constexpr int IDLE_GRACE_MS = 1000;
+
+// a device given on the command line (e.g., md0) may sit on several disks
+constexpr int MAX_PHYSICAL_DISKS = 16;
+
+// a physical disk, whose counters include the IOs of everything stacked on it
+struct physical_disk_t {
+    char name[DEVICE_NAME_LEN];
+    int name_len;
+    bool present;       // found in the last read of /proc/diskstats
+    bool seen;          // counters hold a previous sample
+    bool changed;
+    uint64_t counters[DISKSTATS_FIELDS];
+
+    // deltas of the last sample
+    uint64_t read_ios, read_sectors, write_ios, write_sectors;
+};
+
+// a device given on the command line and its LED
+struct disk_t {
+    char name[DEVICE_NAME_LEN];
+    int shot_fd;
+    bool enabled;
+    bool present;       // any of its physical disks is present
+    bool changed;       // the counters of any of its physical disks changed
+
+    // indices of the physical disks below the device in the physical disk table
+    int physical[MAX_PHYSICAL_DISKS];
+    int num_physical;
+
+    // load of the disk: deltas of the last sample and their moving averages
+    uint64_t read_ios, read_sectors, write_ios, write_sectors;
+    double read_bps, write_bps, read_iops, write_iops;
+    int level;
+
+    // LED attributes used to show the load, -1 if unused
+    int delay_on_fd, delay_off_fd, brightness_fd, color_fd;
+    int base_brightness;
+    char idle_color[32];
+    int shown_color;    // 0: idle color, 1: read color, 2: write color, 3: color of others
+};
+
+static inline const char *skip_spaces(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+static inline const char *parse_u64(const char *p, const char *end, uint64_t &value) {
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (uint64_t)(*p - '0');
+        ++p;
+    }
+    return p;
+}
+
+// read the whole /proc/diskstats with a single pread, growing the buffer
+// only if the file does not fit (i.e. almost never after the first tick)
+static ssize_t read_diskstats(int fd, std::vector<char> &buf) {
+    while (true) {
+        ssize_t n = pread(fd, buf.data(), buf.size(), 0);
+        if (n < 0 || (size_t)n < buf.size()) {
+            return n;
+        }
+        buf.resize(buf.size() * 2);
+    }
+}
+
+// parse all lines of /proc/diskstats and update the physical disks
+static void update_physical_disks(const char *p, const char *end, std::vector<physical_disk_t> &physical_disks) {
+
+    for (auto &disk : physical_disks) {
+        disk.present = false;
+        disk.changed = false;
+    }
+
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+
+        uint64_t major, minor;
+        p = parse_u64(skip_spaces(p, eol), eol, major);
+        p = parse_u64(skip_spaces(p, eol), eol, minor);
+        p = skip_spaces(p, eol);
+
+        const char *name = p;
+        while (p < eol && *p != ' ' && *p != '\t') ++p;
+        int name_len = int(p - name);
+
+        for (auto &disk : physical_disks) {
+
+            if (disk.name_len != name_len || memcmp(disk.name, name, name_len) != 0) {
+                continue;
+            }
+
+            uint64_t counters[DISKSTATS_FIELDS] = { 0 };
+            for (int k = 0; k < DISKSTATS_FIELDS && p < eol; ++k) {
+                p = parse_u64(skip_spaces(p, eol), eol, counters[k]);
+            }
+
+            disk.changed = disk.seen && memcmp(counters, disk.counters, sizeof(counters)) != 0;
+
+            // counters restart from zero when a disk is re-attached
+            auto delta = [&](int k) {
+                return disk.seen && counters[k] >= disk.counters[k] ? counters[k] - disk.counters[k] : 0;
+            };
+            disk.read_ios = delta(DS_READ_IOS);
+            disk.read_sectors = delta(DS_READ_SECTORS);
+            disk.write_ios = delta(DS_WRITE_IOS);
+            disk.write_sectors = delta(DS_WRITE_SECTORS);
+
+            memcpy(disk.counters, counters, sizeof(counters));
+            disk.present = true;
+            disk.seen = true;
+            break;
+        }
+
+        p = eol + 1;
+    }
+}
+
+// sum up the samples of the physical disks below a device
+static void update_disk(disk_t &disk, const std::vector<physical_disk_t> &physical_disks) {
+
+    disk.present = disk.changed = false;
+    disk.read_ios = disk.read_sectors = disk.write_ios = disk.write_sectors = 0;
+
+    for (int k = 0; k < disk.num_physical; ++k) {
+        const physical_disk_t &physical = physical_disks[disk.physical[k]];
+        if (!physical.present) {
+            continue;
+        }
+
+        disk.present = true;
+        disk.changed = disk.changed || physical.changed;
+        disk.read_ios += physical.read_ios;
+        disk.read_sectors += physical.read_sectors;
+        disk.write_ios += physical.write_ios;
+        disk.write_sectors += physical.write_sectors;
+    }
+}
+
+static bool path_exists(const std::string &path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+static std::vector<std::string> list_directory(const std::string &path) {
+    std::vector<std::string> entries;
+    DIR *dir = opendir(path.c_str());
+    if (!dir) return entries;
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            entries.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+// find the physical disks below a block device, following partitions to
+// their disks and md / dm devices to their slaves. Activity on a stacked
+// device is also counted on the disks below it, so only those are read.
+static void resolve_physical_disks(const std::string &name, std::vector<std::string> &result, int depth = 0) {
+
+    if (depth > 8) {
+        return;
+    }
+
+    // an NVMe path of a multipath namespace (nvme0c1n1) is counted on its head (nvme0n1),
+    // and an NVMe controller (nvme0) stands for all of its namespaces
+    unsigned ctrl, path, ns;
+    char tail;
+    if (sscanf(name.c_str(), "nvme%uc%un%u%c", &ctrl, &path, &ns, &tail) == 3) {
+        resolve_physical_disks("nvme" + std::to_string(ctrl) + "n" + std::to_string(ns), result, depth + 1);
+        return;
+    }
+
+    if (sscanf(name.c_str(), "nvme%u%c", &ctrl, &tail) == 1) {
+        for (auto &entry : list_directory("/sys/class/nvme/" + name)) {
+            if (entry.compare(0, name.size() + 1, name + "n") == 0 || entry.compare(0, name.size() + 1, name + "c") == 0) {
+                resolve_physical_disks(entry, result, depth + 1);
+            }
+        }
+        return;
+    }
+
+    std::string sys_path = "/sys/class/block/" + name;
+
+    // a partition is a subdirectory of its disk in sysfs
+    if (path_exists(sys_path + "/partition")) {
+        char real_path[PATH_MAX];
+        if (realpath(sys_path.c_str(), real_path)) {
+            std::string parent(real_path);
+            parent = parent.substr(0, parent.rfind('/'));
+            resolve_physical_disks(parent.substr(parent.rfind('/') + 1), result, depth + 1);
+            return;
+        }
+    }
+
+    std::vector<std::string> slaves = list_directory(sys_path + "/slaves");
+    for (auto &slave : slaves) {
+        resolve_physical_disks(slave, result, depth + 1);
+    }
+
+    if (slaves.empty() && std::find(result.begin(), result.end(), name) == result.end()) {
+        result.push_back(name);
+    }
+}
+
+// (re)build the table of physical disks below the given devices, keeping
+// the samples of the disks that were already in the table
+static void build_physical_disks(std::vector<disk_t> &disks, std::vector<physical_disk_t> &physical_disks) {
+
+    std::vector<physical_disk_t> table;
+
+    for (auto &disk : disks) {
+        std::vector<std::string> names;
+        resolve_physical_disks(disk.name, names);
+
+        // a device that does not exist (yet) is looked up by its own name
+        if (names.empty()) {
+            names.push_back(disk.name);
+        }
+
+        if (names.size() != 1 || names[0] != disk.name) {
+            std::cout << "Resolved " << disk.name << " to";
+            for (auto &name : names) std::cout << " " << name;
+            std::cout << "\n";
+        }
+
+        disk.num_physical = 0;
+
+        for (auto &name : names) {
+            if (name.size() >= DEVICE_NAME_LEN || disk.num_physical >= MAX_PHYSICAL_DISKS) {
+                continue;
+            }
+
+            auto same_name = [&](const physical_disk_t &physical) { return name == physical.name; };
+            auto it = std::find_if(table.begin(), table.end(), same_name);
+
+            if (it == table.end()) {
+                auto old = std::find_if(physical_disks.begin(), physical_disks.end(), same_name);
+                physical_disk_t physical;
+
+                if (old != physical_disks.end()) {
+                    physical = *old;
+                } else {
+                    memset(&physical, 0, sizeof(physical));
+                    memcpy(physical.name, name.c_str(), name.size() + 1);
+                    physical.name_len = int(name.size());
+                }
+
+                table.push_back(physical);
+                it = table.end() - 1;
+            }
+
+            disk.physical[disk.num_physical++] = int(it - table.begin());
+        }
+    }
+
+    physical_disks = std::move(table);
+}
+
+// listen to the uevents of the kernel, returns -1 on failure
+static int open_uevent_socket() {
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+
+    sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;     // kernel uevents
+
+    if (fd >= 0 && bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+// read all pending uevents, and call f(action, devname) for each of a block device
+template <typename F>
+static void read_block_uevents(int fd, F &&f) {
+
+    char buf[8192];
+    ssize_t len;
+
+    while ((len = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+        buf[len] = '\0';
+
+        // the payload is "action@devpath" followed by NUL-separated KEY=value pairs
+        const char *action = "", *subsystem = "", *devname = "";
+        for (ssize_t k = 0; k < len; k += strlen(buf + k) + 1) {
+            const char *field = buf + k;
+            if (strncmp(field, "ACTION=", 7) == 0) action = field + 7;
+            else if (strncmp(field, "SUBSYSTEM=", 10) == 0) subsystem = field + 10;
+            else if (strncmp(field, "DEVNAME=", 8) == 0) devname = field + 8;
+        }
+
+        if (strcmp(subsystem, "block") == 0) {
+            f(action, devname);
+        }
+    }
+}
+
+// fold the deltas of the last sample (dt seconds long) into the moving
+// averages of the load, which forget the past with a time constant tau
+static void update_load(disk_t &disk, double dt, double tau) {
+
+    double alpha = 1 - std::exp(-dt / tau);
+    disk.read_bps += alpha * (disk.read_sectors * 512.0 / dt - disk.read_bps);
+    disk.write_bps += alpha * (disk.write_sectors * 512.0 / dt - disk.write_bps);
+    disk.read_iops += alpha * (disk.read_ios / dt - disk.read_iops);
+    disk.write_iops += alpha * (disk.write_ios / dt - disk.write_iops);
+}
+
+// map the load to 0 (idle) ... LOAD_LEVELS (full scale) on a log scale,
+// so both a few IOs per second and a saturated disk can be told apart
+static int load_level(const disk_t &disk, double full_bps, double full_iops) {
+
+    double bps = disk.read_bps + disk.write_bps;
+    double iops = disk.read_iops + disk.write_iops;
+
+    double bytes_scale = bps > MIN_LOAD_BPS ? std::log(bps / MIN_LOAD_BPS) / std::log(full_bps / MIN_LOAD_BPS) : 0;
+    double ios_scale = std::log1p(iops) / std::log1p(full_iops);
+    double scale = std::min(1.0, std::max(bytes_scale, ios_scale));
+
+    return int(scale * LOAD_LEVELS + 0.5);
+}
+
+static bool write_attr(int fd, const char *value) {
+    return fd >= 0 && pwrite(fd, value, strlen(value), 0) >= 0;
+}
+
+static bool write_attr(int fd, int value) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", value);
+    return write_attr(fd, buf);
+}
+
+// whether two "r g b" colors are the same, whatever the spacing
+static bool same_color(const char *a, const char *b) {
+    int ar, ag, ab, br, bg, bb;
+    return sscanf(a, "%d %d %d", &ar, &ag, &ab) == 3 && sscanf(b, "%d %d %d", &br, &bg, &bb) == 3
+        && ar == br && ag == bg && ab == bb;
+}
+
+static int open_led_attr(const std::string &led_device, const char *attr, int flags) {
+    std::string path = "/sys/class/leds/" + led_device + "/" + attr;
+    int fd = open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to open " << path << "\n";
+    }
+    return fd;
+}
+
+// show the load level of a disk on its LED, writing only what has changed
+static void show_load(disk_t &disk, indication_t indication, int level,
+        const std::string &read_color, const std::string &write_color) {
+
+    if (indication == indication_t::RATE && level > 0 && level != disk.level) {
+        // each shot is one blink cycle, from RATE_MAX_CYCLE_MS at the lowest
+        // level down to RATE_MIN_CYCLE_MS at the full load
+        double ratio = double(level - 1) / (LOAD_LEVELS - 1);
+        int cycle_ms = int(RATE_MAX_CYCLE_MS * std::pow(double(RATE_MIN_CYCLE_MS) / RATE_MAX_CYCLE_MS, ratio));
+        write_attr(disk.delay_on_fd, cycle_ms / 2);
+        write_attr(disk.delay_off_fd, cycle_ms - cycle_ms / 2);
+    }
+
+    if (indication == indication_t::BRIGHTNESS && level != disk.level) {
+        // an idle disk keeps its own brightness, an active one goes from
+        // 1/LOAD_LEVELS of it to the full brightness
+        int brightness = level == 0 ? disk.base_brightness
+            : std::max(1, disk.base_brightness * level / LOAD_LEVELS);
+        write_attr(disk.brightness_fd, brightness);
+    }
+
+    if (disk.color_fd >= 0) {
+        int color = 0;
+        if (level > 0) {
+            color = disk.read_bps + disk.read_iops * 512 >= disk.write_bps + disk.write_iops * 512 ? 1 : 2;
+        }
+
+        const std::string &active_color = color == 1 ? read_color : write_color;
+        if (color != 0 && active_color.empty()) {
+            color = disk.shown_color;
+        }
+
+        // a color written by others during a burst is left alone until the disk is idle
+        if (disk.shown_color == 3) {
+            if (color == 0) {
+                disk.shown_color = 0;
+            }
+            color = disk.shown_color;
+        }
+
+        if (color != disk.shown_color) {
+            char current[32];
+            ssize_t len = pread(disk.color_fd, current, sizeof(current) - 1, 0);
+            current[len > 0 ? len : 0] = '\0';
+
+            const std::string &shown = disk.shown_color == 1 ? read_color : write_color;
+            if (disk.shown_color == 0) {
+                // the color set by others (e.g., the standby checker) when the
+                // burst starts is put back when the disk is idle
+                memcpy(disk.idle_color, current, sizeof(current));
+                write_attr(disk.color_fd, active_color.c_str());
+                disk.shown_color = color;
+            } else if (!same_color(current, shown.c_str())) {
+                // others changed the color during the burst (e.g., a failure or
+                // the standby checker), so theirs is kept instead
+                disk.shown_color = color == 0 ? 0 : 3;
+            } else {
+                write_attr(disk.color_fd, color == 0 ? disk.idle_color : active_color.c_str());
+                disk.shown_color = color;
+            }
+        }
+    }
+
+    disk.level = level;
+}
+
+static std::string read_attr(const std::string &path) {
+    char buf[4096];
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return "";
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    return std::string(buf, len > 0 ? len : 0);
+}
+
+static bool write_attr(const std::string &path, const std::string &value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = write(fd, value.c_str(), value.size()) == (ssize_t)value.size();
+    close(fd);
+    return ok;
+}
+
+// whether the kernel provides the blkdev LED trigger (ledtrig-blkdev, Linux 6.0+),
+// which is listed in the trigger file of every LED as "blkdev" or "[blkdev]"
+static bool blkdev_trigger_available(const std::string &led_device) {
+    std::string triggers = " " + read_attr("/sys/class/leds/" + led_device + "/trigger");
+    for (auto &c : triggers) {
+        if (c == '[' || c == ']' || c == '\n') c = ' ';
+    }
+    return triggers.find(" blkdev ") != std::string::npos;
+}
+
+// let the kernel blink the LED on the activity of the block device
+static bool link_blkdev_trigger_to(const std::string &led_device, const std::string &block_device,
+        int blink_time_ms, int check_interval_ms) {
+
+    std::string led_path = "/sys/class/leds/" + led_device + "/";
+
+    if (path_exists(led_path + "linked_devices/" + block_device)) {
+        return true;
+    }
+
+    if (!path_exists(led_path + "link_dev_by_path") && !write_attr(led_path + "trigger", "blkdev")) {
+        return false;
+    }
+
+    write_attr(led_path + "blink_time", std::to_string(blink_time_ms));
+    write_attr(led_path + "check_interval", std::to_string(check_interval_ms));
+
+    if (!write_attr(led_path + "link_dev_by_path", "/dev/" + block_device)) {
+        return false;
+    }
+
+    std::cout << "Linked " << block_device << " to the blkdev trigger of " << led_device << "\n";
+    return true;
+}
+
+// link all physical disks below a device to the blkdev trigger of its LED
+static bool link_blkdev_trigger(const std::string &led_device, const std::string &block_device,
+        int blink_time_ms, int check_interval_ms) {
+
+    std::vector<std::string> names;
+    resolve_physical_disks(block_device, names);
+
+    bool linked = !names.empty();
+    for (auto &name : names) {
+        linked = link_blkdev_trigger_to(led_device, name, blink_time_ms, check_interval_ms) && linked;
+    }
+
+    return linked;
+}
+
+// hand the blinking over to the blkdev trigger, and only wake up to re-link
+// devices that are added again (e.g., a disk hot-swapped in its slot)
+static int run_blkdev_trigger(const std::vector<std::string> &block_devices,
+        const std::vector<std::string> &led_devices, int blink_time_ms, int check_interval_ms) {
+
+    size_t num_devices = block_devices.size();
+    std::vector<int> retries_left(num_devices, BLKDEV_RETRY_COUNT);
+
+    for (size_t i = 0; i < num_devices; i++) {
+        if (link_blkdev_trigger(led_devices[i], block_devices[i], blink_time_ms, check_interval_ms)) {
+            retries_left[i] = 0;
+        } else {
+            std::cerr << "Failed to link " << block_devices[i] << " to the blkdev trigger of " << led_devices[i] << "\n";
+        }
+    }
+
+    int uevent_fd = open_uevent_socket();
+    if (uevent_fd < 0) {
+        std::cerr << "Failed to listen to uevents, hot-plugged disks will not be linked again\n";
+    }
+
+    while (true) {
+        bool retrying = false;
+        for (int retries : retries_left) {
+            retrying = retrying || retries > 0;
+        }
+
+        if (uevent_fd < 0 && !retrying) {
+            pause();
+            continue;
+        }
+
+        pollfd pfd = { uevent_fd, POLLIN, 0 };
+        if (poll(&pfd, uevent_fd >= 0 ? 1 : 0, retrying ? BLKDEV_RETRY_MS : -1) > 0) {
+            // a new disk may belong to any device (e.g., a member of md0), so try all again
+            read_block_uevents(uevent_fd, [&](const char *action, const char *) {
+                if (strcmp(action, "add") == 0) {
+                    for (size_t i = 0; i < num_devices; i++) {
+                        retries_left[i] = BLKDEV_RETRY_COUNT;
+                    }
+                }
+            });
+        }
+
+        for (size_t i = 0; i < num_devices; i++) {
+            if (retries_left[i] <= 0) {
+                continue;
+            }
+
+            if (link_blkdev_trigger(led_devices[i], block_devices[i], blink_time_ms, check_interval_ms)) {
+                retries_left[i] = 0;
+            } else if (--retries_left[i] == 0) {
+                std::cerr << "Failed to link " << block_devices[i] << " to the blkdev trigger of " << led_devices[i] << "\n";
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options] <sleep time (in second)>"
+        << " <block device 1> <led device 1> <block device 2> <led device 2>...\n"
+        << "A block device can be a disk, a partition, an md / dm device or an NVMe controller,\n"
+        << "whose activity is read from the physical disks below it.\n"
+        << "  -m <seconds>  back off up to this sleep time while no disk is active (default: 1)\n"
+        << "  -s <seconds>  allow the kernel to delay wakeups by this much to coalesce them\n"
+        << "  -M <mode>     how the load is shown: shot, rate or brightness (default: shot)\n"
+        << "                  shot:       blink once whenever the disk is active\n"
+        << "                  rate:       blink faster with a higher load\n"
+        << "                  brightness: shine brighter with a higher load\n"
+        << "  -f <MB/s>     throughput shown as the full load (default: 200)\n"
+        << "  -i <IOPS>     IOs per second shown as the full load (default: 500)\n"
+        << "  -t <seconds>  time constant of the moving average of the load (default: 1)\n"
+        << "  -R \"r g b\"   color of a disk that is mostly read from\n"
+        << "  -W \"r g b\"   color of a disk that is mostly written to\n"
+        << "  -B            let the kernel blink the LEDs with the blkdev trigger if it is available,\n"
+        << "                and keep polling otherwise (the LEDs are off instead of on while idle)\n";
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 4 || argc % 2 != 0) {
-        std::cerr << "Usage: " << argv[0] << " <sleep time (in second)>"
-            << " <block device 1> <led device 1> <block device 2> <led device 2>...\n";
+    double max_sleep_time = 1.0;
+    double timer_slack = 0;
+    indication_t indication = indication_t::SHOT;
+    double full_bps = 200e6;
+    double full_iops = 500;
+    double load_tau = 1.0;
+    std::string read_color, write_color;
+    bool use_blkdev_trigger = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+m:s:M:f:i:t:R:W:Bh")) != -1) {
+        switch (opt) {
+            case 'm':
+                max_sleep_time = std::stod(optarg);
+                break;
+            case 's':
+                timer_slack = std::stod(optarg);
+                break;
+            case 'M':
+                if (std::string(optarg) == "shot") {
+                    indication = indication_t::SHOT;
+                } else if (std::string(optarg) == "rate") {
+                    indication = indication_t::RATE;
+                } else if (std::string(optarg) == "brightness") {
+                    indication = indication_t::BRIGHTNESS;
+                } else {
+                    std::cerr << "Unknown mode " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 'f':
+                full_bps = std::max(2 * MIN_LOAD_BPS, std::stod(optarg) * 1e6);
+                break;
+            case 'i':
+                full_iops = std::max(1.0, std::stod(optarg));
+                break;
+            case 't':
+                load_tau = std::max(0.01, std::stod(optarg));
+                break;
+            case 'R':
+                read_color = optarg;
+                break;
+            case 'W':
+                write_color = optarg;
+                break;
+            case 'B':
+                use_blkdev_trigger = true;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    // positional arguments: <sleep time> followed by <block device> <led device> pairs
+    char **args = argv + optind;
+    int num_args = argc - optind;
+
+    if (num_args < 3 || num_args % 2 == 0) {
+        usage(argv[0]);
         return 1;
     }
 
-    int num_devices = (argc - 2) / 2;
-    int sleep_time_ms = int(std::stod(argv[1]) * 1000);
+    int num_devices = (num_args - 1) / 2;
+    int sleep_time_ms = std::max(1, int(std::stod(args[0]) * 1000));
+    int max_sleep_time_ms = std::max(sleep_time_ms, int(max_sleep_time * 1000));
+
+    // the slack applies to the poll() timeout below, which lets the kernel
+    // fire our wakeup together with other timers of the system
+    if (timer_slack > 0 && prctl(PR_SET_TIMERSLACK, (unsigned long)(timer_slack * 1e9), 0, 0, 0) != 0) {
+        std::cerr << "Failed to set the timer slack\n";
+    }
+
+    if (use_blkdev_trigger) {
+        std::vector<std::string> block_devices, led_devices;
+        for (int i = 0; i < num_devices; i++) {
+            block_devices.push_back(args[1 + 2 * i]);
+            led_devices.push_back(args[2 + 2 * i]);
+        }
+
+        if (blkdev_trigger_available(led_devices[0])) {
+            // the trigger checks the activity at least every 25 ms
+            return run_blkdev_trigger(block_devices, led_devices, 100, std::max(25, sleep_time_ms));
+        }
+
+        std::cerr << "The blkdev LED trigger is not available, polling the disk activities instead\n";
+    }
+
+    int diskstats_fd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    if (diskstats_fd < 0) {
+        std::cerr << "Failed to open /proc/diskstats\n";
+        return 1;
+    }
 
-    std::vector<std::string> block_device_stat_paths;
-    std::vector<std::string> led_device_shot_paths;
+    std::vector<disk_t> disks(num_devices);
 
     for (int i = 0; i < num_devices; i++) {
-        std::string block_device = argv[2 + 2 * i];
-        std::string led_device = argv[3 + 2 * i];
+        std::string block_device = args[1 + 2 * i];
+        std::string led_device = args[2 + 2 * i];
 
-        block_device_stat_paths.push_back(
-                "/sys/block/" + block_device + "/stat");
-        led_device_shot_paths.push_back(
-                "/sys/class/leds/" + led_device + "/shot");
+        disk_t &disk = disks[i];
+        memset(&disk, 0, sizeof(disk));
+        disk.shot_fd = disk.delay_on_fd = disk.delay_off_fd = disk.brightness_fd = disk.color_fd = -1;
+
+        if (block_device.size() >= DEVICE_NAME_LEN) {
+            std::cerr << "Invalid block device " << block_device << "\n";
+            continue;
+        }
+
+        memcpy(disk.name, block_device.c_str(), block_device.size() + 1);
+
+        // the LED files are kept open, so a change is a single write
+        disk.shot_fd = open_led_attr(led_device, "shot", O_WRONLY);
+        if (disk.shot_fd < 0) {
+            continue;
+        }
+
+        if (indication == indication_t::RATE) {
+            disk.delay_on_fd = open_led_attr(led_device, "delay_on", O_WRONLY);
+            disk.delay_off_fd = open_led_attr(led_device, "delay_off", O_WRONLY);
+        } else if (indication == indication_t::BRIGHTNESS) {
+            disk.brightness_fd = open_led_attr(led_device, "brightness", O_RDWR);
+
+            char value[16] = { 0 };
+            if (disk.brightness_fd >= 0 && pread(disk.brightness_fd, value, sizeof(value) - 1, 0) > 0) {
+                disk.base_brightness = atoi(value);
+            }
+            if (disk.base_brightness <= 0) {
+                disk.base_brightness = 255;
+            }
+        }
+
+        if (!read_color.empty() || !write_color.empty()) {
+            disk.color_fd = open_led_attr(led_device, "color", O_RDWR);
+        }
+
+        disk.enabled = true;
     }
 
-    std::vector<bool> device_status(num_devices, true);
-    std::vector<std::string> old_lines(num_devices);
+    // the load is only needed when it is shown
+    bool track_load = indication != indication_t::SHOT || !read_color.empty() || !write_color.empty();
+
+    // the table is rebuilt only when a block device is added, removed or changed
+    std::vector<physical_disk_t> physical_disks;
+    build_physical_disks(disks, physical_disks);
+
+    int uevent_fd = open_uevent_socket();
+    if (uevent_fd < 0) {
+        std::cerr << "Failed to listen to uevents, changes of the disk topology will not be followed\n";
+    }
+
+    std::vector<char> buf(64 * 1024);
+    std::vector<bool> reported_missing(num_devices, false);
+
+    int interval_ms = sleep_time_ms;
+    int idle_ms = 0;
+
+    timespec last_sample;
+    clock_gettime(CLOCK_MONOTONIC, &last_sample);
 
     while (true) {
+        ssize_t n = read_diskstats(diskstats_fd, buf);
+
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double dt = (now.tv_sec - last_sample.tv_sec) + (now.tv_nsec - last_sample.tv_nsec) * 1e-9;
+        last_sample = now;
+
+        if (n < 0) {
+            std::cerr << "Failed to read /proc/diskstats\n";
+            return 1;
+        }
+
+        update_physical_disks(buf.data(), buf.data() + n, physical_disks);
+        bool active = false;
+
         for (int i = 0; i < num_devices; i++) {
+            disk_t &disk = disks[i];
 
-            if (!device_status[i]) {
+            if (!disk.enabled) {
                 continue;
             }
 
-            std::ifstream stat_file(block_device_stat_paths[i]);
+            update_disk(disk, physical_disks);
 
-            if (!stat_file.is_open()) {
-                std::cerr << "Failed to open " << block_device_stat_paths[i] << "\n";
-                device_status[i] = false;
+            // a missing disk is skipped until it shows up again
+            if (!disk.present) {
+                if (!reported_missing[i]) {
+                    std::cerr << "Failed to find " << disk.name << " in /proc/diskstats\n";
+                    reported_missing[i] = true;
+                }
                 continue;
             }
 
-            std::string line;
-            std::getline(stat_file, line);
-            stat_file.close();
+            reported_missing[i] = false;
 
-            if (line != old_lines[i]) {
+            if (track_load && dt > 0) {
+                update_load(disk, dt, load_tau);
+                show_load(disk, indication, load_level(disk, full_bps, full_iops), read_color, write_color);
+                active = active || disk.level > 0;
+            }
 
-                std::ofstream led_file(led_device_shot_paths[i]);
-                if (!led_file.is_open()) {
-                    std::cerr << "Failed to open " << led_device_shot_paths[i] << "\n";
-                    device_status[i] = false;
-                    continue;
+            if (disk.changed) {
+                active = true;
+                if (!write_attr(disk.shot_fd, "1")) {
+                    std::cerr << "Failed to write the shot of " << args[2 + 2 * i] << "\n";
+                    close(disk.shot_fd);
+                    disk.enabled = false;
                 }
+            }
+        }
 
-                led_file << "1";
-                led_file.close();
+        // snap back to the fast interval on activity, back off when idle
+        if (active) {
+            interval_ms = sleep_time_ms;
+            idle_ms = 0;
+        } else if ((idle_ms += interval_ms) >= IDLE_GRACE_MS) {
+            interval_ms = std::min(interval_ms * 2, max_sleep_time_ms);
+        }
+
+        pollfd pfd = { uevent_fd, POLLIN, 0 };
+        if (poll(&pfd, uevent_fd >= 0 ? 1 : 0, interval_ms) > 0) {
+            bool topology_changed = false;
+            read_block_uevents(uevent_fd, [&](const char *, const char *) { topology_changed = true; });
 
-                old_lines[i] = std::move(line);
+            if (topology_changed) {
+                build_physical_disks(disks, physical_disks);
             }
         }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_ms));
     }
 
     return 0;
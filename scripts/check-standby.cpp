@@ -1,111 +1,321 @@
-#include <fstream>
-#include <thread>
 #include <vector>
 #include <iostream>
 #include <string>
 #include <chrono>
 #include <optional>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 
 #include <fcntl.h>
-#include <linux/hdreg.h>
-#include <sys/ioctl.h>
 #include <unistd.h>
 
-std::optional<bool> is_standby_mode(const std::string &device) {
+#include "disk-power.h"
 
-    int fd = open(device.c_str(), O_RDONLY | O_NONBLOCK);
-    if (fd == -1) {
-        std::cerr << "Failed to open device: " << device << std::endl;
-        return std::nullopt;
+using namespace disk_power;
+
+// power mode probes run on a few workers, so a disk blocking its ioctl
+// (e.g., while spinning up) does not delay the other slots
+constexpr int MAX_WORKERS = 4;
+
+// the activity of a disk as seen in /proc/diskstats
+struct disk_activity_t {
+    bool present = false;
+    unsigned long long completed_ios = 0;   // reads, writes, discards and flushes
+    unsigned long long in_flight = 0;
+};
+
+struct device_t {
+    std::string block_device_path;
+    std::string led_device_color_path;
+    disk_t disk;
+    int color_fd = -1;
+
+    bool valid = true;
+    bool standby = false;
+
+    // a probe has been queued or is running, and when it was queued
+    bool in_flight = false;
+    steady_clock::time_point queued_at;
+
+    // the last IO seen in /proc/diskstats, and what it tells about the power mode
+    std::string name;
+    unsigned long long last_completed_ios = 0;
+    standby_tracker_t tracker;
+};
+
+// read the activity of all disks from /proc/diskstats with a single pread
+static void read_disk_activities(int fd, const std::vector<device_t> &devices,
+        std::vector<disk_activity_t> &activities) {
+
+    static char buf[64 * 1024];
+
+    for (auto &activity : activities) {
+        activity.present = false;
+    }
+
+    ssize_t len = fd >= 0 ? pread(fd, buf, sizeof(buf) - 1, 0) : -1;
+    if (len <= 0) {
+        return;
+    }
+    buf[len] = '\0';
+
+    for (char *line = buf; line && *line; ) {
+        char *eol = strchr(line, '\n');
+        if (eol) *eol = '\0';
+
+        char name[64];
+        unsigned long long v[17] = { 0 };
+        int fields = sscanf(line, " %*u %*u %63s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+                name, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8],
+                &v[9], &v[10], &v[11], &v[12], &v[13], &v[14], &v[15], &v[16]);
+
+        if (fields >= 12) {
+            for (size_t i = 0; i < devices.size(); i++) {
+                if (devices[i].name == name) {
+                    // fields: 0 reads, 4 writes, 8 in flight, 11 discards, 15 flushes
+                    activities[i].present = true;
+                    activities[i].completed_ios = v[0] + v[4] + v[11] + v[15];
+                    activities[i].in_flight = v[8];
+                }
+            }
+        }
+
+        line = eol ? eol + 1 : nullptr;
     }
+}
 
-    unsigned char args[4] = { WIN_CHECKPOWERMODE1, 0, 0, 0 };
+// switch between the standby and the normal color, unless the LED shows
+// another color (e.g., a disk failure set by ugreen-diskiomon)
+static bool apply_standby_color(device_t &device, bool standby,
+        const std::string &standby_color, const std::string &normal_color) {
 
-    if (ioctl(fd, HDIO_DRIVE_CMD, args) == -1) {
-        std::cerr << "ioctl failed in checking power mode of " << device << std::endl;
-        close(fd);
-        return std::nullopt;
+    char buf[64];
+    ssize_t len = pread(device.color_fd, buf, sizeof(buf) - 1, 0);
+    if (len < 0) {
+        return false;
     }
 
-    close(fd);
+    buf[len] = '\0';
+    std::string current_color(buf, strcspn(buf, "\n"));
 
-    return args[2] == 0x00;
+    const std::string &from = standby ? normal_color : standby_color;
+    const std::string &to = standby ? standby_color : normal_color;
+
+    if (current_color == from && pwrite(device.color_fd, to.c_str(), to.size(), 0) < 0) {
+        return false;
+    }
+
+    return true;
+}
+
+// change the known power mode of a disk, and its LED color
+static void set_standby(device_t &device, bool standby,
+        const std::string &standby_color, const std::string &normal_color) {
+
+    if (standby == device.standby) {
+        return;
+    }
+
+    if (!apply_standby_color(device, standby, standby_color, normal_color)) {
+        std::cerr << "Failed to update led color file: "
+            << device.led_device_color_path << std::endl;
+        device.valid = false;
+        return;
+    }
+
+    device.standby = standby;
 }
 
 int main(int argc, char *argv[]) {
 
-    constexpr int preleading_args = 4;
+    double probe_deadline = 5.0;
+    double spindown_timeout = 0;
+    double standby_recheck = 60;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+t:s:r:")) != -1) {
+        if (opt == 't') {
+            probe_deadline = std::stod(optarg);
+        } else if (opt == 's') {
+            spindown_timeout = std::stod(optarg);
+        } else if (opt == 'r') {
+            standby_recheck = std::stod(optarg);
+        } else {
+            return 1;
+        }
+    }
+
+    constexpr int preleading_args = 3;
+    char **args = argv + optind;
+    int num_args = argc - optind;
 
-    if (argc < preleading_args + 2 || (argc - preleading_args) % 2 != 0) {
-        std::cerr << "Usage: " << argv[0] 
+    if (num_args < preleading_args + 2 || (num_args - preleading_args) % 2 != 0) {
+        std::cerr << "Usage: " << argv[0]
+            << " [-t <probe deadline>] [-s <spin-down timeout>] [-r <recheck interval>]"
             << " <check interval (in second)>"
             << " <disk standby color>"
             << " <disk normal color>"
-            << " <block device 1> <led device 1> <block device 2> <led device 2>...\n";
+            << " <block device 1> <led device 1> <block device 2> <led device 2>...\n"
+            << "  -t <seconds>  give up a disk whose power mode check takes longer than this,\n"
+            << "                which is also the command timeout of SCSI and NVMe disks (default: 5)\n"
+            << "  -s <seconds>  spin-down timeout of the disks, an active disk is not checked\n"
+            << "                before being idle for this long (default: 0, unknown)\n"
+            << "  -r <seconds>  longest time between two checks of an idle disk (default: 60),\n"
+            << "                an idle spinning disk is checked every interval without -s\n";
         return 1;
     }
 
-    int num_devices = (argc - preleading_args) / 2;
-    int checker_sleep_ms = int(std::stod(argv[1]) * 1000);
+    int num_devices = (num_args - preleading_args) / 2;
+    auto checker_sleep = std::chrono::milliseconds(int(std::stod(args[0]) * 1000));
+    auto probe_deadline_ms = std::chrono::milliseconds(int(probe_deadline * 1000));
+    probe_timeout_ms = std::max(1, int(probe_deadline * 1000));
 
-    std::string standby_color = argv[2];
-    std::string normal_color = argv[3];
-    std::vector<std::string> block_device_paths;
-    std::vector<std::string> led_device_color_paths;
+    standby_policy_t policy;
+    policy.check_interval = checker_sleep;
+    policy.spindown_timeout = std::chrono::milliseconds(int(spindown_timeout * 1000));
+    policy.standby_recheck = std::chrono::milliseconds(int(standby_recheck * 1000));
 
-    std::cout << normal_color;
+    std::string standby_color = args[1];
+    std::string normal_color = args[2];
+    std::vector<device_t> devices(num_devices);
 
     for (int i = 0; i < num_devices; i++) {
-        std::string block_device = argv[preleading_args + 2 * i];
-        std::string led_device = argv[preleading_args + 2 * i + 1];
+        device_t &device = devices[i];
+        std::string block_device = args[preleading_args + 2 * i];
+        std::string led_device = args[preleading_args + 2 * i + 1];
 
+        device.name = block_device;
+        device.block_device_path = "/dev/" + block_device;
+        device.led_device_color_path = "/sys/class/leds/" + led_device + "/color";
 
-        block_device_paths.push_back(
-                "/dev/" + block_device);
-        led_device_color_paths.push_back(
-                "/sys/class/leds/" + led_device + "/color");
+        // both files are kept open for the whole run
+        device.disk.fd = open(device.block_device_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (device.disk.fd == -1) {
+            std::cerr << "Failed to open device: " << device.block_device_path << std::endl;
+            device.valid = false;
+            continue;
+        }
+
+        device.color_fd = open(device.led_device_color_path.c_str(), O_RDWR | O_CLOEXEC);
+        if (device.color_fd == -1) {
+            std::cerr << "Failed to open led color file: "
+                << device.led_device_color_path << std::endl;
+            device.valid = false;
+            continue;
+        }
     }
 
-    std::vector<bool> device_valid(num_devices, true);
-    std::vector<bool> device_standby(num_devices, false);
+    // the backend of each disk is chosen by its first probe
+    probe_pool_t pool(std::min(num_devices, MAX_WORKERS));
+
+    // the power mode is inferred from the IO of the disks when possible,
+    // and only asked from the disks whose state is ambiguous
+    int diskstats_fd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    if (diskstats_fd == -1) {
+        std::cerr << "Failed to open /proc/diskstats, checking every disk in every round" << std::endl;
+    }
+
+    std::vector<disk_activity_t> activities(num_devices);
+
+    auto next_check = steady_clock::now();
 
     while (true) {
-        for (int i = 0; i < num_devices; i++) {
+        auto now = steady_clock::now();
 
-            if (!device_valid[i]) {
-                continue;
-            }
+        if (now >= next_check) {
+            read_disk_activities(diskstats_fd, devices, activities);
 
-            auto is_standby = is_standby_mode(block_device_paths[i]);
+            for (int i = 0; i < num_devices; i++) {
+                device_t &device = devices[i];
 
-            if (!is_standby.has_value()) {
-                device_valid[i] = false;
-                continue;
-            }
+                if (!device.valid) {
+                    continue;
+                }
 
-            if (is_standby.value() != device_standby[i]) {
-                std::fstream led_color(led_device_color_paths[i], std::ios::in | std::ios::out);
-                if (!led_color) {
-                    std::cerr << "Failed to open led color file: " 
-                        << led_device_color_paths[i] << std::endl;
-                    device_valid[i] = false;
+                // a probe past the deadline is given up with its disk: an ioctl
+                // without a timeout (HDIO_DRIVE_CMD) may never return, so its
+                // worker is replaced to keep probing the other disks. the first
+                // probe may try all three kinds of commands.
+                auto deadline = device.disk.backend == probe_backend_t::none ? probe_deadline_ms * 3 : probe_deadline_ms;
+                if (device.in_flight && now - device.queued_at > deadline) {
+                    std::cerr << "Checking power mode of " << device.block_device_path
+                        << " takes longer than " << probe_deadline << " s, not checking it anymore"
+                        << std::endl;
+                    device.valid = false;
+                    pool.add_worker();
                     continue;
                 }
 
-                std::string current_color;
-                std::getline(led_color, current_color);
+                // completed or pending IO means that the disk is spinning
+                const disk_activity_t &activity = activities[i];
+                if (activity.present) {
+                    bool has_io = activity.completed_ios != device.last_completed_ios || activity.in_flight > 0;
+                    device.last_completed_ios = activity.completed_ios;
 
-                if (device_standby[i] && current_color == standby_color) {
-                    led_color << normal_color << std::endl;
-                } else if (!device_standby[i] && current_color == normal_color) {
-                    led_color << standby_color << std::endl;
+                    if (has_io) {
+                        device.tracker.saw_io(now, policy);
+                        set_standby(device, false, standby_color, normal_color);
+                        continue;
+                    }
+
+                    if (!device.tracker.needs_probe(device.standby, now, policy)) {
+                        continue;
+                    }
+                }
+
+                // a probe still running from an earlier round is not queued again
+                if (device.in_flight) {
+                    continue;
                 }
 
-                device_standby[i] = is_standby.value();
+                device.in_flight = true;
+                device.queued_at = now;
+                device.tracker.last_probe_at = now;
+                pool.submit(i, device.disk);
+            }
+
+            next_check += checker_sleep;
+            if (next_check < now) {
+                next_check = now + checker_sleep;
             }
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(checker_sleep_ms));
+        // results are applied as soon as they arrive, so a slow disk never
+        // holds back the LEDs of the others
+        for (auto &result : pool.wait_results(next_check)) {
+            device_t &device = devices[result.index];
+            device.in_flight = false;
+
+            // the late result of a probe that was given up
+            if (!device.valid) {
+                continue;
+            }
+
+            if (result.disk.backend == probe_backend_t::none) {
+                std::cerr << "Failed to find a way to check power mode of "
+                    << device.block_device_path << std::endl;
+                device.valid = false;
+                continue;
+            }
+            device.disk = result.disk;
+
+            if (!result.standby.has_value()) {
+                std::cerr << "Failed to check power mode of " << device.block_device_path
+                    << " (" << backend_name(device.disk.backend) << ")" << std::endl;
+                device.valid = false;
+                continue;
+            }
+
+            // IO seen while the probe was running wins over its result
+            if (device.tracker.last_io_at > device.queued_at) {
+                continue;
+            }
+
+            device.tracker.probed(result.standby.value(), policy);
+            set_standby(device, result.standby.value(), standby_color, normal_color);
+        }
     }
 
     return 0;
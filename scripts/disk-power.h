@@ -0,0 +1,395 @@
+// Asking the power mode of disks without waking them up, shared by
+// check-standby and the C++ ugreen_diskiomon (cli/)
+
+#ifndef DISK_POWER_H
+#define DISK_POWER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <optional>
+#include <algorithm>
+#include <cstdint>
+
+#include <linux/hdreg.h>
+#include <linux/nvme_ioctl.h>
+#include <scsi/sg.h>
+#include <sys/ioctl.h>
+
+namespace disk_power {
+
+using steady_clock = std::chrono::steady_clock;
+
+// how long the disk may take for a SCSI or NVMe command before the kernel
+// aborts it; HDIO_DRIVE_CMD has no timeout
+inline unsigned int probe_timeout_ms = 5000;
+
+// how the power mode of a disk is asked, chosen once per disk
+enum class probe_backend_t {
+    none,
+    ata,                // HDIO_DRIVE_CMD, i.e. SATA disks on libata
+    ata_passthrough,    // SG_IO with ATA PASS-THROUGH, e.g. SATA disks behind a SAS HBA
+    scsi_sense,         // SG_IO with REQUEST SENSE, i.e. SAS disks
+    nvme,               // NVMe admin Get Features (Power Management)
+};
+
+inline const char *backend_name(probe_backend_t backend) {
+    switch (backend) {
+        case probe_backend_t::ata: return "ATA";
+        case probe_backend_t::ata_passthrough: return "ATA PASS-THROUGH";
+        case probe_backend_t::scsi_sense: return "SCSI REQUEST SENSE";
+        case probe_backend_t::nvme: return "NVMe Get Features";
+        default: return "none";
+    }
+}
+
+// an open disk and how its power mode is asked
+struct disk_t {
+    int fd = -1;
+    probe_backend_t backend = probe_backend_t::none;
+    uint32_t nvme_non_operational = 0;  // bit i is set when power state i is non-operational
+};
+
+// CHECK POWER MODE returns 0x00 in the count register when the disk is in standby
+inline std::optional<bool> ata_is_standby(int fd) {
+
+    unsigned char args[4] = { WIN_CHECKPOWERMODE1, 0, 0, 0 };
+
+    if (ioctl(fd, HDIO_DRIVE_CMD, args) == -1) {
+        return std::nullopt;
+    }
+
+    return args[2] == 0x00;
+}
+
+// the driver status of SG_IO when sense data has been returned
+constexpr unsigned int SG_DRIVER_SENSE = 0x08;
+
+// send a SCSI command without data out, and return whether it completed
+inline bool scsi_command(int fd, unsigned char *cdb, unsigned char cdb_len,
+        unsigned char *data, unsigned int data_len, unsigned char *sense, unsigned char sense_len,
+        bool &check_condition) {
+
+    sg_io_hdr_t io = {};
+    io.interface_id = 'S';
+    io.cmdp = cdb;
+    io.cmd_len = cdb_len;
+    io.dxfer_direction = data_len ? SG_DXFER_FROM_DEV : SG_DXFER_NONE;
+    io.dxferp = data;
+    io.dxfer_len = data_len;
+    io.sbp = sense;
+    io.mx_sb_len = sense_len;
+    io.timeout = probe_timeout_ms;
+
+    if (ioctl(fd, SG_IO, &io) == -1 || io.host_status != 0
+            || (io.driver_status & ~SG_DRIVER_SENSE) != 0) {
+        return false;
+    }
+
+    check_condition = io.status == 0x02 && io.sb_len_wr > 0;
+    return io.status == 0x00 || check_condition;
+}
+
+// CHECK POWER MODE through ATA PASS-THROUGH (16), with CK_COND set so that
+// the registers come back in the sense data
+inline std::optional<bool> ata_passthrough_is_standby(int fd) {
+
+    unsigned char cdb[16] = { 0 };
+    cdb[0] = 0x85;              // ATA PASS-THROUGH (16)
+    cdb[1] = 3 << 1;            // protocol: non-data
+    cdb[2] = 0x20;              // CK_COND, no data transfer
+    cdb[14] = WIN_CHECKPOWERMODE1;
+
+    unsigned char sense[32] = { 0 };
+    bool check_condition = false;
+
+    if (!scsi_command(fd, cdb, sizeof(cdb), nullptr, 0, sense, sizeof(sense), check_condition)
+            || !check_condition) {
+        return std::nullopt;
+    }
+
+    unsigned char response_code = sense[0] & 0x7f;
+
+    // descriptor format, with the ATA Status Return descriptor first
+    if (response_code == 0x72 && sense[8] == 0x09 && sense[9] >= 0x0c) {
+        return sense[8 + 5] == 0x00;
+    }
+
+    // fixed format, with the count register in the information field
+    if (response_code == 0x70 && sense[12] == 0x00 && sense[13] == 0x1d) {
+        return sense[6] == 0x00;
+    }
+
+    return std::nullopt;
+}
+
+// REQUEST SENSE reports the power condition of a SAS disk as 5E/xx without changing it
+inline std::optional<bool> scsi_sense_is_standby(int fd) {
+
+    unsigned char cdb[6] = { 0x03, 0, 0, 0, 252, 0 };       // REQUEST SENSE
+    unsigned char data[252] = { 0 };
+    unsigned char sense[32] = { 0 };
+    bool check_condition = false;
+
+    if (!scsi_command(fd, cdb, sizeof(cdb), data, sizeof(data), sense, sizeof(sense), check_condition)
+            || check_condition) {
+        return std::nullopt;
+    }
+
+    unsigned char response_code = data[0] & 0x7f;
+    unsigned char asc, ascq;
+
+    if (response_code == 0x72 || response_code == 0x73) {
+        asc = data[2];
+        ascq = data[3];
+    } else if (response_code == 0x70 || response_code == 0x71) {
+        asc = data[12];
+        ascq = data[13];
+    } else {
+        return std::nullopt;
+    }
+
+    // standby by timer or command, and standby_y by timer or command
+    return asc == 0x5e && (ascq == 0x02 || ascq == 0x04 || ascq == 0x09 || ascq == 0x0a);
+}
+
+// the power state of an NVMe controller, from Get Features (Power Management)
+inline std::optional<unsigned int> nvme_power_state(int fd) {
+
+    nvme_admin_cmd cmd = {};
+    cmd.opcode = 0x0a;          // Get Features
+    cmd.cdw10 = 0x02;           // Power Management, current value
+    cmd.timeout_ms = probe_timeout_ms;
+
+    if (ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd) != 0) {
+        return std::nullopt;
+    }
+
+    return cmd.result & 0x1f;
+}
+
+// the non-operational power states of an NVMe controller, from Identify Controller
+inline std::optional<uint32_t> nvme_non_operational_states(int fd) {
+
+    std::vector<unsigned char> id(4096);
+
+    nvme_admin_cmd cmd = {};
+    cmd.opcode = 0x06;          // Identify
+    cmd.addr = (uint64_t)(uintptr_t)id.data();
+    cmd.data_len = id.size();
+    cmd.cdw10 = 0x01;           // controller
+    cmd.timeout_ms = probe_timeout_ms;
+
+    if (ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd) != 0) {
+        return std::nullopt;
+    }
+
+    // NPSS is zero-based, each power state descriptor has NOPS in bit 1 of byte 3
+    uint32_t non_operational = 0;
+    unsigned int npss = std::min<unsigned int>(id[263], 31);
+    for (unsigned int ps = 0; ps <= npss; ps++) {
+        if (id[2048 + 32 * ps + 3] & 0x02) {
+            non_operational |= 1u << ps;
+        }
+    }
+
+    return non_operational;
+}
+
+inline std::optional<bool> is_standby_mode(const disk_t &disk) {
+
+    switch (disk.backend) {
+        case probe_backend_t::ata:
+            return ata_is_standby(disk.fd);
+        case probe_backend_t::ata_passthrough:
+            return ata_passthrough_is_standby(disk.fd);
+        case probe_backend_t::scsi_sense:
+            return scsi_sense_is_standby(disk.fd);
+        case probe_backend_t::nvme: {
+            auto ps = nvme_power_state(disk.fd);
+            if (!ps.has_value()) {
+                return std::nullopt;
+            }
+            return (disk.nvme_non_operational >> ps.value() & 1) != 0;
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+// find the first way of asking the power mode that the disk answers
+inline void choose_backend(disk_t &disk) {
+
+    int fd = disk.fd;
+
+    if (ioctl(fd, NVME_IOCTL_ID) > 0) {
+        auto non_operational = nvme_non_operational_states(fd);
+        if (non_operational.has_value() && nvme_power_state(fd).has_value()) {
+            disk.backend = probe_backend_t::nvme;
+            disk.nvme_non_operational = non_operational.value();
+        }
+        return;
+    }
+
+    if (ata_is_standby(fd).has_value()) {
+        disk.backend = probe_backend_t::ata;
+    } else if (ata_passthrough_is_standby(fd).has_value()) {
+        disk.backend = probe_backend_t::ata_passthrough;
+    } else if (scsi_sense_is_standby(fd).has_value()) {
+        disk.backend = probe_backend_t::scsi_sense;
+    }
+}
+
+// the result of a probe; the backend is chosen by the first probe of a disk,
+// and stays none when the disk answers none of them
+struct probe_result_t {
+    int index;
+    disk_t disk;
+    std::optional<bool> standby;
+};
+
+// a small pool of workers running the power mode probes, so a disk blocking
+// its ioctl (e.g., while spinning up) does not delay the other disks. the
+// workers share their state with the pool, so that a worker stuck in a probe
+// may outlive it.
+class probe_pool_t {
+public:
+    explicit probe_pool_t(int num_workers) : shared(std::make_shared<shared_t>()) {
+        for (int i = 0; i < num_workers; i++) {
+            add_worker();
+        }
+    }
+
+    ~probe_pool_t() {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->stopping = true;
+        shared->jobs_cv.notify_all();
+    }
+
+    probe_pool_t(const probe_pool_t &) = delete;
+    probe_pool_t &operator=(const probe_pool_t &) = delete;
+
+    // also replaces a worker stuck in a probe that was given up
+    void add_worker() {
+        std::thread(&probe_pool_t::worker, shared).detach();
+    }
+
+    // the fd of the disk must stay open until its result has been taken
+    void submit(int index, const disk_t &disk) {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->jobs.push_back({ index, disk, std::nullopt });
+        shared->jobs_cv.notify_one();
+    }
+
+    // wait until a result is ready or the deadline has passed, and take all ready results
+    std::vector<probe_result_t> wait_results(steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->results_cv.wait_until(lock, deadline, [this] { return !shared->results.empty(); });
+        std::vector<probe_result_t> ready;
+        ready.swap(shared->results);
+        return ready;
+    }
+
+private:
+    struct shared_t {
+        std::mutex mutex;
+        std::condition_variable jobs_cv, results_cv;
+        std::deque<probe_result_t> jobs;
+        std::vector<probe_result_t> results;
+        bool stopping = false;
+    };
+
+    static void worker(std::shared_ptr<shared_t> shared) {
+        while (true) {
+            probe_result_t job;
+            {
+                std::unique_lock<std::mutex> lock(shared->mutex);
+                shared->jobs_cv.wait(lock, [&] { return shared->stopping || !shared->jobs.empty(); });
+                if (shared->stopping) {
+                    return;
+                }
+                job = shared->jobs.front();
+                shared->jobs.pop_front();
+            }
+
+            if (job.disk.backend == probe_backend_t::none) {
+                choose_backend(job.disk);
+            }
+            job.standby = is_standby_mode(job.disk);
+
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->results.push_back(job);
+            shared->results_cv.notify_one();
+        }
+    }
+
+    std::shared_ptr<shared_t> shared;
+};
+
+// how often the power mode of an idle disk is asked
+struct standby_policy_t {
+    steady_clock::duration check_interval{};
+    steady_clock::duration spindown_timeout{};      // zero if unknown
+    steady_clock::duration standby_recheck{};       // longest time between two checks of an idle disk
+};
+
+// what is known about the power mode of a disk without asking it: whether it
+// has been probed at all, the last IO seen, and when to ask again
+struct standby_tracker_t {
+    bool state_known = false;
+    steady_clock::time_point last_io_at;
+    steady_clock::time_point last_probe_at;
+    steady_clock::duration active_recheck{};
+
+    // completed or pending IO means that the disk is spinning
+    void saw_io(steady_clock::time_point at, const standby_policy_t &policy) {
+        state_known = true;
+        last_io_at = at;
+        active_recheck = policy.check_interval;
+    }
+
+    // whether the power mode of an idle disk has to be asked from the disk itself
+    bool needs_probe(bool standby, steady_clock::time_point now, const standby_policy_t &policy) const {
+
+        if (!state_known) {
+            return true;
+        }
+
+        // nothing but IO spins a disk up, so only an occasional check is needed
+        if (standby) {
+            return policy.standby_recheck.count() > 0 && now - last_probe_at >= policy.standby_recheck;
+        }
+
+        // an active disk cannot spin down before its timeout has passed
+        if (policy.spindown_timeout.count() > 0 && now - last_io_at < policy.spindown_timeout) {
+            return false;
+        }
+
+        return now - last_probe_at >= active_recheck;
+    }
+
+    // a probe has answered; an idle disk that is still spinning is asked again
+    // less and less often, but only when the spin-down timeout is known:
+    // otherwise the disk may spin down any time, which is then shown within
+    // one check interval
+    void probed(bool standby, const standby_policy_t &policy) {
+
+        state_known = true;
+        if (standby) {
+            return;
+        }
+
+        auto longest_recheck = policy.spindown_timeout.count() > 0
+            ? std::max(policy.standby_recheck, policy.check_interval)
+            : policy.check_interval;
+        active_recheck = std::min(std::max(active_recheck * 2, policy.check_interval), longest_recheck);
+    }
+};
+
+} // namespace disk_power
+
+#endif // DISK_POWER_H